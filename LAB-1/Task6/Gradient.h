@@ -0,0 +1,33 @@
+#ifndef Gradient_h
+#define Gradient_h
+#include <opencv2/opencv.hpp>
+
+/*
+Image gradient computed once and shared by the stages that need it (Canny, lines, circles).
+For the 3x3 aperture Gx, Gy, the magnitude and the orientation come out of a single pass over
+the image, written with the universal intrinsics of OpenCV (cv::v_int16, cv::v_int32), so it is
+vectorised also in the builds without optimisations; the other apertures go through cv::Sobel
+first. The border is replicated and the 7x7 derivatives are scaled by 1/16, like cv::Canny does.
+*/
+struct Gradient {
+    // Orientation sectors, decided with the same fixed point tan(22.5 deg) test of cv::Canny
+    enum Direction : uchar {
+        HORIZONTAL = 0, // gradient along x, the edge is vertical
+        VERTICAL = 1,   // gradient along y, the edge is horizontal
+        DIAGONAL = 2,   // Gx and Gy with the same sign
+        ANTI_DIAGONAL = 3 // Gx and Gy with opposite signs
+    };
+
+    cv::Mat gx, gy;      // CV_16SC1
+    cv::Mat magnitude;   // CV_32SC1, |Gx| + |Gy|, or the rounded sqrt(Gx^2 + Gy^2) when l2 is set
+    cv::Mat orientation; // CV_8UC1, one Direction per pixel
+    bool l2 = false;
+
+    static void compute(const cv::Mat& gray, Gradient& gradient, int aperture_size = 3, bool l2 = false);
+
+    private:
+    static void fused3x3(const cv::Mat& gray, Gradient& gradient);
+    static void fromDerivatives(Gradient& gradient);
+};
+
+#endif
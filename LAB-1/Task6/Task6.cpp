@@ -1,5 +1,6 @@
 #include <opencv2/opencv.hpp>
 #include "Filters.h"
+#include "Gradient.h"
 #include <iostream>
 
 
@@ -29,9 +30,12 @@ int main(int argc, char** argv){
     //cv::blur(gray, output2, cv::Size(kernelSize, kernelSize));
     
     
-    //SobelFilter:
-    cv::Sobel(gray, output2, CV_64F, 1, 0, kernelSize);
-    cv::Sobel(gray, output3, CV_64F, 0, 1, kernelSize);
+    //SobelFilter: Gx and Gy computed in int16 by the shared gradient, then converted to the
+    //signed CV_64F images that were shown before (same values, only the border is replicated)
+    Gradient gradient;
+    Gradient::compute(gray, gradient, kernelSize);
+    gradient.gx.convertTo(output2, CV_64F);
+    gradient.gy.convertTo(output3, CV_64F);
 
 
     //Max filter
@@ -0,0 +1,152 @@
+#include "BitMask.h"
+#include <opencv2/core/hal/hal.hpp>
+#include <cstring>
+#include <algorithm>
+
+BitMask::BitMask(int rows, int cols) : n_rows(rows), n_cols(cols) {
+    packed = cv::Mat::zeros(rows, (cols + 7) / 8, CV_8UC1);
+}
+
+BitMask::BitMask(const cv::Mat& mask) {
+    fromMat(mask);
+}
+
+BitMask& BitMask::operator=(const BitMask& other) {
+    if (this != &other) {
+        n_rows = other.n_rows;
+        n_cols = other.n_cols;
+        packed = other.packed.clone();
+    }
+    return *this;
+}
+
+void BitMask::fromMat(const cv::Mat& mask) {
+    CV_Assert(mask.depth() == CV_8U);
+    n_rows = mask.rows;
+    n_cols = mask.cols;
+    packed = cv::Mat::zeros(n_rows, (n_cols + 7) / 8, CV_8UC1);
+
+    const int channels = mask.channels();
+    for (int j = 0; j < n_rows; j++) {
+        const uchar* src = mask.ptr<uchar>(j);
+        uchar* dst = packed.ptr<uchar>(j);
+        for (int i = 0; i < n_cols; i++) {
+            //a pixel is set if any of its channels is not 0
+            uchar on = 0;
+            for (int c = 0; c < channels; c++) on |= src[i * channels + c];
+            if (on) dst[i >> 3] |= (uchar)(0x80 >> (i & 7));
+        }
+    }
+}
+
+void BitMask::toMat(cv::Mat& output, uchar value) const {
+    output.create(n_rows, n_cols, CV_8UC1);
+    for (int j = 0; j < n_rows; j++) {
+        const uchar* src = packed.ptr<uchar>(j);
+        uchar* dst = output.ptr<uchar>(j);
+        for (int i = 0; i < n_cols; i++) {
+            dst[i] = ((src[i >> 3] >> (7 - (i & 7))) & 1) ? value : 0;
+        }
+    }
+}
+
+void BitMask::set(int y, int x, bool value) {
+    uchar bit = (uchar)(0x80 >> (x & 7));
+    uchar& byte = packed.ptr<uchar>(y)[x >> 3];
+    byte = value ? (byte | bit) : (byte & ~bit);
+}
+
+BitMask& BitMask::operator&=(const BitMask& other) {
+    CV_Assert(n_rows == other.n_rows && n_cols == other.n_cols);
+    cv::bitwise_and(packed, other.packed, packed);
+    return *this;
+}
+
+BitMask& BitMask::operator|=(const BitMask& other) {
+    CV_Assert(n_rows == other.n_rows && n_cols == other.n_cols);
+    cv::bitwise_or(packed, other.packed, packed);
+    return *this;
+}
+
+BitMask& BitMask::operator^=(const BitMask& other) {
+    CV_Assert(n_rows == other.n_rows && n_cols == other.n_cols);
+    cv::bitwise_xor(packed, other.packed, packed);
+    return *this;
+}
+
+BitMask BitMask::operator~() const {
+    BitMask result;
+    result.n_rows = n_rows;
+    result.n_cols = n_cols;
+    cv::bitwise_not(packed, result.packed);
+    result.clearPadding(); // the bits after the last column must stay 0
+    return result;
+}
+
+void BitMask::clearPadding() {
+    int used_bits = n_cols & 7;
+    if (used_bits == 0) return;
+    uchar keep = (uchar)(0xFF << (8 - used_bits));
+    int last = packed.cols - 1;
+    for (int j = 0; j < n_rows; j++) {
+        packed.ptr<uchar>(j)[last] &= keep;
+    }
+}
+
+int BitMask::count() const {
+    if (packed.empty()) return 0;
+    // packed is always continuous since we allocate it ourselves
+    return cv::hal::normHamming(packed.ptr<uchar>(0), (int)packed.total());
+}
+
+cv::Rect BitMask::boundingRect() const {
+    int top = -1, bottom = -1;
+    // OR of all the rows, the first and last non zero bits of it are the horizontal limits
+    cv::Mat columns = cv::Mat::zeros(1, packed.cols, CV_8UC1);
+    for (int j = 0; j < n_rows; j++) {
+        cv::Mat row = packed.row(j);
+        if (cv::hal::normHamming(row.ptr<uchar>(0), packed.cols) == 0) continue;
+        if (top < 0) top = j;
+        bottom = j;
+        cv::bitwise_or(columns, row, columns);
+    }
+    if (top < 0) return cv::Rect();
+
+    const uchar* bytes = columns.ptr<uchar>(0);
+    int first = 0, last = packed.cols - 1;
+    while (bytes[first] == 0) first++;
+    while (bytes[last] == 0) last--;
+
+    int left = first * 8, right = last * 8 + 7;
+    while (!((bytes[first] >> (7 - (left & 7))) & 1)) left++;
+    while (!((bytes[last] >> (7 - (right & 7))) & 1)) right--;
+
+    return cv::Rect(left, top, right - left + 1, bottom - top + 1);
+}
+
+void BitMask::copyMasked(const cv::Mat& src, cv::Mat& dst) const {
+    CV_Assert(src.rows == n_rows && src.cols == n_cols);
+    CV_Assert(dst.size() == src.size() && dst.type() == src.type());
+    const size_t pixel_size = src.elemSize();
+
+    for (int j = 0; j < n_rows; j++) {
+        const uchar* bits_row = packed.ptr<uchar>(j);
+        const uchar* src_row = src.ptr<uchar>(j);
+        uchar* dst_row = dst.ptr<uchar>(j);
+        for (int b = 0; b < packed.cols; b++) {
+            uchar byte = bits_row[b];
+            if (byte == 0) continue; // 8 pixels skipped at once
+            int x0 = b * 8;
+            int n = std::min(8, n_cols - x0);
+            if (byte == 0xFF && n == 8) {
+                std::memcpy(dst_row + x0 * pixel_size, src_row + x0 * pixel_size, 8 * pixel_size);
+                continue;
+            }
+            for (int k = 0; k < n; k++) {
+                if ((byte >> (7 - k)) & 1) {
+                    std::memcpy(dst_row + (x0 + k) * pixel_size, src_row + (x0 + k) * pixel_size, pixel_size);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef ColorPalette_h
+#define ColorPalette_h
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <functional>
+#include "BitMask.h"
+
+/*
+Quantises a 3 channel 8 bit image once into a 16x16x16 grid (4096 entries).
+Every pixel gets the index of its grid cell and every entry keeps how many pixels fell in it
+and their mean colour, so a click only has to test the 4096 entries instead of the whole image.
+*/
+class ColorPalette {
+    public:
+    static const int LEVELS = 16;                        // levels per channel
+    static const int ENTRIES = LEVELS * LEVELS * LEVELS; // 4096
+
+    // first_channel_range is 256 for BGR images and 180 for the hue of an OpenCV HSV image
+    void build(const cv::Mat& image, int first_channel_range = 256);
+
+    // Builds the mask (a CV_8UC1 0/255 cv::Mat or a BitMask) of all the pixels whose palette entry passes the test
+    // and returns the number of matched pixels, which is known from the counts before touching the image.
+    // If cancelled() becomes true during the pass over the image it stops and returns -1.
+    template<typename Test, typename Mask>
+    int select(const cv::Vec3b& target, const Test& test, Mask& mask,
+               const std::function<bool()>& cancelled = nullptr) const {
+        std::vector<uchar> lut(ENTRIES, 0);
+        int area = 0;
+        for (int e = 0; e < ENTRIES; e++) {
+            if (counts[e] > 0 && test(colors[e], target)) {
+                lut[e] = 255;
+                area += counts[e];
+            }
+        }
+        if (!applyLUT(lut, mask, cancelled)) return -1;
+        return area;
+    }
+
+    // One pass over the index image: mask(y,x) = lut[index(y,x)], false if it was cancelled
+    bool applyLUT(const std::vector<uchar>& lut, cv::Mat& mask, const std::function<bool()>& cancelled = nullptr) const;
+    // Same pass, but the result is packed directly 8 pixels per byte
+    bool applyLUT(const std::vector<uchar>& lut, BitMask& mask, const std::function<bool()>& cancelled = nullptr) const;
+
+    int entryOf(const cv::Vec3b& color) const;
+    const cv::Mat& indices() const { return index; }
+    int count(int entry) const { return counts[entry]; }
+    const cv::Vec3b& color(int entry) const { return colors[entry]; }
+
+    private:
+    int first_range = 256;
+    cv::Mat index;                 // CV_16UC1, palette entry of every pixel
+    std::vector<int> counts;       // number of pixels of every entry
+    std::vector<cv::Vec3b> colors; // mean colour of every entry
+};
+
+#endif
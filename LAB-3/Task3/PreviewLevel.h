@@ -0,0 +1,40 @@
+#ifndef PreviewLevel_h
+#define PreviewLevel_h
+#include <opencv2/opencv.hpp>
+
+/*
+Level of the image pyramid used for the quick preview of the interactive tools.
+Big images (longer side above LARGE_SIDE) are previewed on the first level whose longer side is
+at most PREVIEW_SIDE, and the windows show that level: the clicks arrive in preview coordinates and
+are mapped to the full resolution image (and back) through the pixel centres.
+Images that are not big have level 0: no preview, everything runs at full resolution as before.
+*/
+class PreviewLevel {
+    public:
+    static const int LARGE_SIDE = 2048;
+    static const int PREVIEW_SIDE = 1024;
+
+    explicit PreviewLevel(const cv::Size& full_size);
+
+    int level() const { return pyramid_level; }
+    bool active() const { return pyramid_level > 0; }
+    cv::Size fullSize() const { return full_size; }
+    cv::Size size() const { return preview_size; }
+
+    // pyrDown level() times (a shallow copy at level 0)
+    void downscale(const cv::Mat& full, cv::Mat& preview) const;
+    // For binary images (masks, edges): a preview pixel is set if any of its full resolution pixels is,
+    // so the thin lines do not disappear
+    void downscaleMask(const cv::Mat& full, cv::Mat& preview) const;
+
+    cv::Point toFull(const cv::Point& p) const;
+    cv::Point toPreview(const cv::Point& p) const;
+
+    private:
+    static int mapCoordinate(int value, int from, int to);
+
+    cv::Size full_size, preview_size;
+    int pyramid_level = 0;
+};
+
+#endif
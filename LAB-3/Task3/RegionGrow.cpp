@@ -0,0 +1,91 @@
+#include "RegionGrow.h"
+#include <cstring>
+
+// The scanline fill is the same for every tolerance test, so it is written only once
+template<typename Test>
+Region RegionGrow::scanlineFill(const cv::Mat& image, cv::Point seed, const Test& test) {
+    CV_Assert(image.type() == CV_8UC3);
+    if (visited.size() != image.size()) {
+        visited = cv::Mat::zeros(image.size(), CV_8UC1); // first call, or an image of another size
+    } else {
+        for (const Span& span : region_spans) {
+            std::memset(visited.ptr<uchar>(span.y) + span.left, 0, span.right - span.left + 1);
+        }
+    }
+    region_spans.clear();
+
+    Region region;
+    if (seed.x < 0 || seed.x >= image.cols || seed.y < 0 || seed.y >= image.rows) {
+        return region;
+    }
+
+    const cv::Vec3b target = image.at<cv::Vec3b>(seed);
+    int min_x = seed.x, max_x = seed.x, min_y = seed.y, max_y = seed.y;
+
+    // a pixel can join the region if it was not visited yet and it passes the test
+    auto canJoin = [&](int x, int y) {
+        return visited.at<uchar>(y, x) == 0 && test(image.at<cv::Vec3b>(y, x), target);
+    };
+
+    std::vector<cv::Point> stack;
+    stack.push_back(seed);
+
+    while (!stack.empty()) {
+        cv::Point p = stack.back();
+        stack.pop_back();
+        if (!canJoin(p.x, p.y)) continue; // already filled by another span
+
+        // Extend the span to the left and to the right as long as the pixels pass the test
+        int left = p.x, right = p.x;
+        while (left > 0 && canJoin(left - 1, p.y)) left--;
+        while (right < image.cols - 1 && canJoin(right + 1, p.y)) right++;
+
+        std::memset(visited.ptr<uchar>(p.y) + left, 255, right - left + 1);
+        region_spans.push_back({p.y, left, right});
+
+        region.area += right - left + 1;
+        min_x = std::min(min_x, left);
+        max_x = std::max(max_x, right);
+        min_y = std::min(min_y, p.y);
+        max_y = std::max(max_y, p.y);
+
+        // Only one seed for every run of free pixels in the row above and in the row below
+        for (int ny = p.y - 1; ny <= p.y + 1; ny += 2) {
+            if (ny < 0 || ny >= image.rows) continue;
+            bool in_run = false;
+            for (int i = left; i <= right; i++) {
+                if (canJoin(i, ny)) {
+                    if (!in_run) stack.push_back(cv::Point(i, ny));
+                    in_run = true;
+                } else {
+                    in_run = false;
+                }
+            }
+        }
+    }
+
+    if (region.area > 0) {
+        region.bounding_box = cv::Rect(min_x, min_y, max_x - min_x + 1, max_y - min_y + 1);
+    }
+    return region;
+}
+
+Region RegionGrow::grow(const cv::Mat& image, cv::Point seed, const BGRTolerance& test) {
+    return scanlineFill(image, seed, test);
+}
+
+Region RegionGrow::grow(const cv::Mat& image, cv::Point seed, const HSVTolerance& test) {
+    return scanlineFill(image, seed, test);
+}
+
+void RegionGrow::paint(BitMask& mask) const {
+    CV_Assert(mask.rows() == visited.rows && mask.cols() == visited.cols);
+    for (const Span& span : region_spans) {
+        uchar* row = mask.ptr(span.y);
+        int x = span.left;
+        // bit by bit up to a byte boundary, then 8 pixels at a time
+        for (; x <= span.right && (x & 7) != 0; x++) mask.set(span.y, x);
+        for (; x + 7 <= span.right; x += 8) row[x >> 3] = 0xFF;
+        for (; x <= span.right; x++) mask.set(span.y, x);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef RegionGrow_h
+#define RegionGrow_h
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "ColorTolerance.h"
+#include "BitMask.h"
+
+// What the region growing found: the bounding box and the number of pixels of the connected region
+struct Region {
+    cv::Rect bounding_box;
+    int area = 0;
+};
+
+/*
+Seeded region growing with a scanline flood fill (4-connectivity).
+A pixel joins the region if it passes the same tolerance test used by the global masks
+against the colour of the seed, but only the pixels connected to the seed are visited,
+so the cost is proportional to the size of the region and not of the image.
+The region is kept as its horizontal spans. The map of the visited pixels is kept between
+two calls and only the spans of the previous region are cleared, so a click on an image
+already seen does not touch the rest of it (only used by one thread at a time).
+*/
+class RegionGrow {
+    public:
+    // Pixels left ... right (both included) of row y
+    struct Span {
+        int y;
+        int left;
+        int right;
+    };
+
+    Region grow(const cv::Mat& image, cv::Point seed, const BGRTolerance& test);
+    Region grow(const cv::Mat& image, cv::Point seed, const HSVTolerance& test);
+
+    // Spans of the last region, in the order they were filled
+    const std::vector<Span>& spans() const { return region_spans; }
+    // Sets the pixels of the last region in a mask of the size of the image
+    void paint(BitMask& mask) const;
+
+    private:
+    template<typename Test>
+    Region scanlineFill(const cv::Mat& image, cv::Point seed, const Test& test);
+
+    cv::Mat visited; // CV_8UC1, 255 on the spans of the last region only
+    std::vector<Span> region_spans;
+};
+
+#endif
@@ -2,19 +2,54 @@
 #include <iostream>
 #include <string>
 #include <cmath> 
+#include "ColorPalette.h"
+#include "ColorTolerance.h"
+#include "RegionGrow.h"
+#include "BitMask.h"
+#include "MaskWorker.h"
+#include "PreviewLevel.h"
+#include "SessionLog.h"
+#include <sstream>
 
 // Structure to hold the data needed by the callback
 struct MouseCallbackData {
     const cv::Mat* original_image_ptr; //it's const because I don't want that the original image can be modified
     cv::Mat* display_image_ptr;      // it will become the mask
+    const ColorPalette* palette_ptr; // palette index of the original image, built once in main
+    RegionGrow* region_grow_ptr;     // region growing of the Ctrl+clicks (only used by the worker thread)
+    MaskWorker* worker_ptr;          // computes the masks off the GUI thread
     std::string window_name;         
+
+    // Progressive mode for big images: the windows show a pyramid level, every click is first
+    // computed there and refined at full resolution when the user pauses (only used by the GUI thread)
+    const PreviewLevel* preview_ptr;         // level shown in the windows
+    const cv::Mat* preview_image_ptr;        // original image at the preview level
+    const ColorPalette* preview_palette_ptr; // palette index of the preview image
+    RegionGrow* preview_region_grow_ptr;     // region growing on the preview image (only used by the worker thread)
+    MaskWorker::Job refine_job;              // full resolution job waiting for a pause
+    int64 last_click_tick = 0;
+
+    SessionRecorder* recorder_ptr = nullptr; // logs the clicks (--record)
+    bool headless = false;                   // replay: nothing is shown
 };
 
 void click(int event, int x, int y, int flags, void* userdata);
+// Mask of a click computed on the preview level or at full resolution
+MaskWorker::Job maskJob(MouseCallbackData* data, const cv::Vec3b& color, int tolerance, bool grow_region,
+                        const cv::Point& seed, bool full_resolution);
+// Feeds a recorded session to the callback without a display and prints the latency percentiles
+int replaySession(MouseCallbackData& data, const std::string& path);
 
 int main(int argc, char** argv) {
 
-    std::string filename = "Robocup.jpg";
+    // Task3 [image] [--record <session file> | --replay <session file>]
+    std::string filename = "Robocup.jpg", record_path, replay_path;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--record" && i + 1 < argc) record_path = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc) replay_path = argv[++i];
+        else filename = arg;
+    }
 
     cv::Mat original_image = cv::imread(filename); // Load the original image
     if (original_image.empty()) {
@@ -22,23 +57,74 @@ int main(int argc, char** argv) {
         return -1;
     }
 
-    cv::Mat display_image = original_image.clone();
+    // Quantise the image once, every click will only test the palette entries
+    ColorPalette palette;
+    palette.build(original_image);
+
+    // Pyramid level shown in the windows (the image itself when it is not big), with its own palette
+    PreviewLevel preview(original_image.size());
+    cv::Mat preview_image;
+    preview.downscale(original_image, preview_image);
+    ColorPalette preview_palette;
+    if (preview.active()) {
+        preview_palette.build(preview_image);
+        std::cout << "Big image: previews at 1/" << (1 << preview.level()) << " resolution, refined when idle" << std::endl;
+    }
+
+    // Region growing of the Ctrl+clicks, one per level so each keeps its map of the visited pixels
+    RegionGrow region_grow, preview_region_grow;
+
+    cv::Mat display_image = preview_image.clone();
     std::string window_title = "Mask";
 
     // Prepare the data structure to pass to the callback
     MouseCallbackData cb_data;
     cb_data.original_image_ptr = &original_image; // Address of the original
     cb_data.display_image_ptr = &display_image;    // Address of the one to create and display
+    cb_data.palette_ptr = &palette;
+    cb_data.region_grow_ptr = &region_grow;
     cb_data.window_name = window_title;
+    cb_data.preview_ptr = &preview;
+    cb_data.preview_image_ptr = &preview_image;
+    cb_data.preview_palette_ptr = preview.active() ? &preview_palette : &palette;
+    cb_data.preview_region_grow_ptr = &preview_region_grow;
+
+    // Declared after everything it uses, so it is stopped before them
+    MaskWorker worker;
+    cb_data.worker_ptr = &worker;
+
+    if (!replay_path.empty()) return replaySession(cb_data, replay_path);
+
+    SessionRecorder recorder;
+    if (!record_path.empty()) {
+        if (!recorder.open(record_path)) {
+            std::cerr << "Error: could not write " << record_path << std::endl;
+            return -1;
+        }
+        cb_data.recorder_ptr = &recorder;
+        std::cout << "Recording the session to " << record_path << std::endl;
+    }
 
     cv::namedWindow(window_title);
     cv::namedWindow("Image");
     // Pass the address of our data structure as userdata
     cv::setMouseCallback("Image", click, &cb_data);
 
-    cv::imshow("Image", original_image);
+    cv::imshow("Image", preview_image);
     cv::imshow(window_title, display_image); // Initial display (shows original at first)
-    cv::waitKey(0);
+
+    // Show the masks posted back by the worker until a key is pressed
+    const double refine_delay_ms = 300; // pause after the last click before refining
+    while (cv::waitKey(10) < 0) {
+        worker.poll();
+
+        // The refinement goes to the same worker, so a new click cancels it like any other job
+        double idle_ms = (cv::getTickCount() - cb_data.last_click_tick) * 1000.0 / cv::getTickFrequency();
+        if (cb_data.refine_job && idle_ms >= refine_delay_ms) {
+            worker.submit(std::move(cb_data.refine_job));
+            cb_data.refine_job = nullptr;
+        }
+    }
     return 0;
 }
 
@@ -51,49 +137,108 @@ void click(int event, int x, int y, int flags, void* userdata) {
         MouseCallbackData* data = static_cast<MouseCallbackData*>(userdata);
 
         // Make sure the pointers in the data structure are valid (basic check)
-        if (!data || !data->original_image_ptr || !data->display_image_ptr) {
+        if (!data || !data->original_image_ptr || !data->display_image_ptr || !data->palette_ptr || !data->region_grow_ptr || !data->worker_ptr || !data->preview_ptr || !data->preview_image_ptr || !data->preview_palette_ptr || !data->preview_region_grow_ptr) {
              std::cerr << "Error: Invalid userdata passed to callback." << std::endl;
              return;
         }
+        if (data->recorder_ptr) data->recorder_ptr->record("mouse", {event, x, y, flags});
 
         // Get direct references/pointers for convenience
         const cv::Mat& original_img = *(data->original_image_ptr);
-        cv::Mat& display_img = *(data->display_image_ptr); // We will modify this one
-        const std::string& window_name = data->window_name;
+
+        // The window shows the preview level: back to the full resolution pixel
+        cv::Point seed = data->preview_ptr->toFull(cv::Point(x, y));
 
         // Get the clicked pixel color
-        cv::Vec3b clicked_pixel_color = original_img.at<cv::Vec3b>(y, x);
+        cv::Vec3b clicked_pixel_color = original_img.at<cv::Vec3b>(seed);
         std::cout << "Clicked Color (BGR): "
                   << (int)clicked_pixel_color[0] << ", "
                   << (int)clicked_pixel_color[1] << ", "
                   << (int)clicked_pixel_color[2] << std::endl;
 
         int tolerance = 45;
-
-        // Create a new mask image, initialized to black with the same dim of the origina
-        cv::Mat mask = cv::Mat::zeros(original_img.size(), original_img.type());
-
-        for (int j = 0; j < original_img.rows; j++) { // Iterate rows
-            for (int i = 0; i < original_img.cols; i++) { // Iterate columns
-
-                // Get the current pixel color 
-                cv::Vec3b current_pixel_color = original_img.at<cv::Vec3b>(j, i);
-
-                // Check if *each* channel is within the tolerance range
-                bool blue_ok  = std::abs(current_pixel_color[0] - clicked_pixel_color[0]) <= tolerance;
-                bool green_ok = std::abs(current_pixel_color[1] - clicked_pixel_color[1]) <= tolerance;
-                bool red_ok   = std::abs(current_pixel_color[2] - clicked_pixel_color[2]) <= tolerance;
-
-                // If all channels are within tolerance, make the pixel white in the mask
-                if (blue_ok && green_ok && red_ok) {
-                    mask.at<cv::Vec3b>(j, i) = cv::Vec3b(255, 255, 255);
-                }
-                // No 'else' needed because the mask was initialized to black
-            }
+        bool grow_region = (flags & cv::EVENT_FLAG_CTRLKEY) != 0;
+
+        // The mask is computed by the worker, off the GUI thread; a newer click cancels this one.
+        // Big images get a quick preview first, the full resolution job waits for a pause.
+        data->last_click_tick = cv::getTickCount();
+        if (data->preview_ptr->active()) {
+            data->worker_ptr->submit(maskJob(data, clicked_pixel_color, tolerance, grow_region, seed, false));
+            data->refine_job = maskJob(data, clicked_pixel_color, tolerance, grow_region, seed, true);
+        } else {
+            data->worker_ptr->submit(maskJob(data, clicked_pixel_color, tolerance, grow_region, seed, true));
         }
+    }
+}
 
-        display_img = mask; // This modifies the 'display_image' variable in main()
+MaskWorker::Job maskJob(MouseCallbackData* data, const cv::Vec3b& color, int tolerance, bool grow_region,
+                        const cv::Point& seed, bool full_resolution) {
+    return [data, color, tolerance, grow_region, seed, full_resolution](const MaskWorker::CancelCheck& cancelled) {
+        const PreviewLevel& preview = *(data->preview_ptr);
+        // Image and palette of the level
+        const cv::Mat& image = full_resolution ? *(data->original_image_ptr) : *(data->preview_image_ptr);
+        const ColorPalette& palette = full_resolution ? *(data->palette_ptr) : *(data->preview_palette_ptr);
+        cv::Point level_seed = full_resolution ? seed : preview.toPreview(seed);
+        std::ostringstream report;
+        // Both selections are packed one bit per pixel, they are unpacked only for the display
+        BitMask selection;
+        if (grow_region) {
+            // Ctrl+click: grow only the connected region under the cursor and set its spans
+            RegionGrow& region_grow = full_resolution ? *(data->region_grow_ptr) : *(data->preview_region_grow_ptr);
+            Region region = region_grow.grow(image, level_seed, BGRTolerance{tolerance});
+            selection = BitMask(image.rows, image.cols);
+            region_grow.paint(selection);
+            report << "Region: " << region.area << " pixels, bounding box " << region.bounding_box << std::endl;
+        } else {
+            // Test the tolerance on the palette entries and build the mask with one lookup per pixel
+            int area = palette.select(color, BGRTolerance{tolerance}, selection, cancelled);
+            if (area < 0) return MaskWorker::Display();
+            report << "Matched pixels: " << area << ", bounding box " << selection.boundingRect() << std::endl;
+        }
+        cv::Mat mask;
+        selection.toMat(mask);
+        if (cancelled()) return MaskWorker::Display();
+
+        // The windows show the preview level
+        if (full_resolution) preview.downscaleMask(mask, mask);
+        if (cancelled()) return MaskWorker::Display();
+
+        // This part runs on the GUI thread
+        std::string text = report.str();
+        return MaskWorker::Display([data, mask, text, full_resolution]() {
+            if (!full_resolution) {
+                std::cout << "Preview (1/" << (1 << data->preview_ptr->level()) << " resolution, coordinates of the preview)\n";
+            }
+            std::cout << text;
+            *(data->display_image_ptr) = mask; // This modifies the 'display_image' variable in main()
+            if (!data->headless) cv::imshow(data->window_name, mask);
+        });
+    };
+}
 
-        cv::imshow(window_name, display_img); // Use the updated display_img
+int replaySession(MouseCallbackData& data, const std::string& path) {
+    SessionReplayer replayer;
+    if (!replayer.load(path)) {
+        std::cerr << "Error: could not read the session " << path << std::endl;
+        return -1;
     }
-}
\ No newline at end of file
+    std::cout << "Replaying " << replayer.events().size() << " events of " << path << std::endl;
+
+    data.headless = true;
+    replayer.run([&data](const SessionEvent& event) {
+        if (event.type != "mouse" || event.values.size() != 4) return;
+        click(event.values[0], event.values[1], event.values[2], event.values[3], &data);
+    }, [&data]() {
+        data.worker_ptr->wait();
+        data.worker_ptr->poll();
+        // No pause to wait for: the full resolution refinement of a big image starts after its preview
+        if (data.refine_job) {
+            data.worker_ptr->submit(std::move(data.refine_job));
+            data.refine_job = nullptr;
+            data.worker_ptr->wait();
+            data.worker_ptr->poll();
+        }
+    });
+    replayer.printReport(std::cout);
+    return 0;
+}
@@ -0,0 +1,56 @@
+#ifndef MaskWorker_h
+#define MaskWorker_h
+#include <opencv2/opencv.hpp>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+/*
+Runs the mask generation of the mouse callbacks on a background thread, so HighGUI never freezes.
+Only the latest click matters: submitting a job cancels the one in flight (it sees cancelled()
+become true and gives up) and replaces the one still waiting. When a job finishes, what it
+wants to show is posted back and executed by poll() on the GUI thread.
+*/
+class MaskWorker {
+    public:
+    typedef std::function<bool()> CancelCheck;
+    // What must be done with the result on the GUI thread (usually an imshow)
+    typedef std::function<void()> Display;
+    // A job returns an empty Display when it has been cancelled
+    typedef std::function<Display(const CancelCheck& cancelled)> Job;
+
+    MaskWorker();
+    ~MaskWorker();
+
+    // Called by the mouse callback (GUI thread)
+    void submit(Job job);
+    // Called by the GUI loop: shows the result of the latest job if it is ready and prints the
+    // latency from the click to the display. Returns true if something was shown.
+    bool poll();
+    // Blocks until no job is waiting or running (headless replay: the result is then ready for poll())
+    void wait();
+
+    private:
+    void run();
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake_up;
+    std::condition_variable idle;
+    bool stop = false;
+    bool running = false;
+
+    std::atomic<unsigned long> generation{0}; // incremented by every submit, the jobs of older generations are cancelled
+    Job pending_job;
+    int64 pending_tick = 0;
+
+    Display ready_display;
+    unsigned long ready_generation = 0;
+    int64 ready_submit_tick = 0;
+    double ready_compute_ms = 0;
+    int cancelled_jobs = 0;
+};
+
+#endif
@@ -0,0 +1,211 @@
+#include "RunLengthMask.h"
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+namespace {
+
+const char MAGIC[4] = {'R', 'L', 'E', '1'};
+// Largest number of rows or columns accepted by load(), far above any image of the labs
+const unsigned int MAX_SIDE = 1 << 16;
+
+// Unsigned LEB128: 7 bits per byte, the highest bit says that another byte follows
+void putVarint(std::vector<uchar>& out, unsigned int value) {
+    while (value >= 0x80) {
+        out.push_back((uchar)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uchar)value);
+}
+
+bool getVarint(const uchar*& in, const uchar* end, unsigned int& value) {
+    value = 0;
+    for (int shift = 0; in < end && shift < 35; shift += 7) {
+        uchar byte = *in++;
+        value |= (unsigned int)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// Appends a run to the row being built, merging it with the last one if they touch
+void appendRun(std::vector<RunLengthMask::Run>& runs, int row_begin, int start, int end) {
+    if (start >= end) return;
+    if ((int)runs.size() > row_begin && runs.back().end >= start) {
+        runs.back().end = std::max(runs.back().end, end);
+    } else {
+        runs.push_back({start, end});
+    }
+}
+
+}
+
+RunLengthMask::RunLengthMask(int rows, int cols) : n_rows(rows), n_cols(cols), row_offsets(rows + 1, 0) {}
+
+void RunLengthMask::encode(const cv::Mat& mask) {
+    CV_Assert(mask.type() == CV_8UC1);
+    n_rows = mask.rows;
+    n_cols = mask.cols;
+    row_offsets.assign(n_rows + 1, 0);
+    all_runs.clear();
+
+    for (int j = 0; j < n_rows; j++) {
+        const uchar* src = mask.ptr<uchar>(j);
+        int i = 0;
+        while (i < n_cols) {
+            //skip the background, then take all the consecutive foreground pixels
+            while (i < n_cols && src[i] == 0) i++;
+            int start = i;
+            while (i < n_cols && src[i] != 0) i++;
+            if (i > start) all_runs.push_back({start, i});
+        }
+        row_offsets[j + 1] = (int)all_runs.size();
+    }
+}
+
+void RunLengthMask::decode(cv::Mat& output, uchar value) const {
+    output = cv::Mat::zeros(n_rows, n_cols, CV_8UC1);
+    for (int j = 0; j < n_rows; j++) {
+        uchar* dst = output.ptr<uchar>(j);
+        for (int r = rowBegin(j); r < rowEnd(j); r++) {
+            std::memset(dst + all_runs[r].start, value, all_runs[r].end - all_runs[r].start);
+        }
+    }
+}
+
+int RunLengthMask::count() const {
+    int total = 0;
+    for (const Run& run : all_runs) total += run.end - run.start;
+    return total;
+}
+
+template<typename Op>
+RunLengthMask RunLengthMask::combine(const RunLengthMask& other, Op op) const {
+    CV_Assert(n_rows == other.n_rows && n_cols == other.n_cols);
+    RunLengthMask result(n_rows, n_cols);
+
+    for (int j = 0; j < n_rows; j++) {
+        // Sweep the boundaries of the two rows: between two consecutive boundaries both inputs
+        // are constant, so the output is constant too
+        int a = rowBegin(j), a_end = rowEnd(j);
+        int b = other.rowBegin(j), b_end = other.rowEnd(j);
+        int row_begin = (int)result.all_runs.size();
+        int x = 0;
+        while (a < a_end || b < b_end) {
+            bool in_a = a < a_end && all_runs[a].start <= x;
+            bool in_b = b < b_end && other.all_runs[b].start <= x;
+            int next = n_cols;
+            if (a < a_end) next = std::min(next, in_a ? all_runs[a].end : all_runs[a].start);
+            if (b < b_end) next = std::min(next, in_b ? other.all_runs[b].end : other.all_runs[b].start);
+            if (op(in_a, in_b)) appendRun(result.all_runs, row_begin, x, next);
+            x = next;
+            if (a < a_end && all_runs[a].end <= x) a++;
+            if (b < b_end && other.all_runs[b].end <= x) b++;
+        }
+        if (op(false, false)) appendRun(result.all_runs, row_begin, x, n_cols);
+        result.row_offsets[j + 1] = (int)result.all_runs.size();
+    }
+    return result;
+}
+
+RunLengthMask RunLengthMask::operator&(const RunLengthMask& other) const {
+    return combine(other, [](bool a, bool b) { return a && b; });
+}
+
+RunLengthMask RunLengthMask::operator|(const RunLengthMask& other) const {
+    return combine(other, [](bool a, bool b) { return a || b; });
+}
+
+RunLengthMask RunLengthMask::operator^(const RunLengthMask& other) const {
+    return combine(other, [](bool a, bool b) { return a != b; });
+}
+
+RunLengthMask RunLengthMask::dilate(int radius_x, int radius_y) const {
+    // Horizontal pass: every run grows by radius_x on both sides
+    RunLengthMask wide(n_rows, n_cols);
+    for (int j = 0; j < n_rows; j++) {
+        int row_begin = (int)wide.all_runs.size();
+        for (int r = rowBegin(j); r < rowEnd(j); r++) {
+            appendRun(wide.all_runs, row_begin,
+                      std::max(0, all_runs[r].start - radius_x), std::min(n_cols, all_runs[r].end + radius_x));
+        }
+        wide.row_offsets[j + 1] = (int)wide.all_runs.size();
+    }
+    if (radius_y == 0) return wide;
+
+    // Vertical pass: every output row is the union of the 2 * radius_y + 1 rows around it
+    RunLengthMask result(n_rows, n_cols);
+    std::vector<Run> window;
+    for (int j = 0; j < n_rows; j++) {
+        window.clear();
+        for (int k = std::max(0, j - radius_y); k <= std::min(n_rows - 1, j + radius_y); k++) {
+            window.insert(window.end(), wide.all_runs.begin() + wide.rowBegin(k), wide.all_runs.begin() + wide.rowEnd(k));
+        }
+        std::sort(window.begin(), window.end(), [](const Run& a, const Run& b) { return a.start < b.start; });
+        int row_begin = (int)result.all_runs.size();
+        for (const Run& run : window) appendRun(result.all_runs, row_begin, run.start, run.end);
+        result.row_offsets[j + 1] = (int)result.all_runs.size();
+    }
+    return result;
+}
+
+bool RunLengthMask::save(const std::string& path) const {
+    std::vector<uchar> buffer(MAGIC, MAGIC + 4);
+    putVarint(buffer, n_rows);
+    putVarint(buffer, n_cols);
+    for (int j = 0; j < n_rows; j++) {
+        putVarint(buffer, rowEnd(j) - rowBegin(j));
+        int previous_end = 0;
+        for (int r = rowBegin(j); r < rowEnd(j); r++) {
+            //runs never touch, so the length is at least 1 and the gap is at least 1 after the first run
+            putVarint(buffer, all_runs[r].start - previous_end);
+            putVarint(buffer, all_runs[r].end - all_runs[r].start - 1);
+            previous_end = all_runs[r].end;
+        }
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+    file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    return (bool)file;
+}
+
+bool RunLengthMask::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    std::vector<uchar> buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (buffer.size() < 4 || std::memcmp(buffer.data(), MAGIC, 4) != 0) return false;
+
+    const uchar* in = buffer.data() + 4;
+    const uchar* end = buffer.data() + buffer.size();
+    unsigned int rows, cols;
+    if (!getVarint(in, end, rows) || !getVarint(in, end, cols)) return false;
+    // Checked before anything is allocated or written: the header comes from the file
+    if (rows > MAX_SIDE || cols > MAX_SIDE) return false;
+
+    RunLengthMask result(rows, cols);
+    for (unsigned int j = 0; j < rows; j++) {
+        unsigned int n_runs;
+        if (!getVarint(in, end, n_runs)) return false;
+        // Every run takes at least one pixel and two bytes of the file
+        if (n_runs > cols || n_runs > (size_t)(end - in) / 2) return false;
+        // 64 bit positions, so a huge gap or length cannot wrap around and pass the check
+        uint64_t x = 0;
+        for (unsigned int r = 0; r < n_runs; r++) {
+            unsigned int gap, length;
+            if (!getVarint(in, end, gap) || !getVarint(in, end, length)) return false;
+            if (r > 0 && gap == 0) return false; // the runs of a row never touch
+            uint64_t start = x + gap;
+            uint64_t stop = start + length + 1;
+            if (stop > cols) return false; // the run goes past the end of the row
+            result.all_runs.push_back({(int)start, (int)stop});
+            x = stop;
+        }
+        result.row_offsets[j + 1] = (int)result.all_runs.size();
+    }
+
+    *this = std::move(result);
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef RunLengthMask_h
+#define RunLengthMask_h
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <string>
+
+/*
+Binary image (mask or edge map) stored as runs of consecutive non zero pixels, row by row.
+Masks and edge maps are very sparse, so the runs are much smaller than the image and
+the logical operations and the dilation are done directly on them.
+*/
+class RunLengthMask {
+    public:
+    struct Run {
+        int start; // first pixel of the run
+        int end;   // one after the last pixel of the run
+    };
+
+    RunLengthMask() {}
+    RunLengthMask(int rows, int cols);
+
+    // Every non zero pixel (CV_8UC1) is part of a run
+    void encode(const cv::Mat& mask);
+    // Back to a CV_8UC1 image (0 / value)
+    void decode(cv::Mat& output, uchar value = 255) const;
+
+    int rows() const { return n_rows; }
+    int cols() const { return n_cols; }
+    // Runs of row y are runs()[rowBegin(y)] ... runs()[rowEnd(y) - 1], sorted and not touching
+    int rowBegin(int y) const { return row_offsets[y]; }
+    int rowEnd(int y) const { return row_offsets[y + 1]; }
+    const std::vector<Run>& runs() const { return all_runs; }
+
+    // Number of non zero pixels
+    int count() const;
+
+    RunLengthMask operator&(const RunLengthMask& other) const;
+    RunLengthMask operator|(const RunLengthMask& other) const;
+    RunLengthMask operator^(const RunLengthMask& other) const;
+
+    // Dilation with a (2 * radius_x + 1) x (2 * radius_y + 1) rectangle
+    RunLengthMask dilate(int radius_x, int radius_y) const;
+
+    // Compact binary file: header, then for every row the number of runs and, for every run,
+    // the gap from the previous run and the length, all as variable length integers.
+    // load() rejects a file larger than 65536 pixels on a side or with runs out of the rows
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+
+    private:
+    template<typename Op>
+    RunLengthMask combine(const RunLengthMask& other, Op op) const;
+
+    int n_rows = 0;
+    int n_cols = 0;
+    std::vector<int> row_offsets; // rows + 1 entries
+    std::vector<Run> all_runs;
+};
+
+#endif
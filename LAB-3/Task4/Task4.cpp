@@ -3,22 +3,63 @@
 #include <string>
 #include <cmath>
 #include <algorithm> // Needed for std::min
+#include "ColorModel.h"
+#include "ColorTolerance.h" // hueDifference and the HSV tolerance test
+#include "RegionGrow.h"
+#include "BitMask.h"
+#include "RunLengthMask.h"
+#include "ConnectedComponents.h"
+#include "MaskWorker.h"
+#include "PreviewLevel.h"
+#include "SessionLog.h"
+#include <sstream>
+#include <memory>
 
 // Structure to hold the data needed by the callback
 struct MouseCallbackData {
     const cv::Mat* original_bgr_image_ptr; // Pointer to the original BGR image (for display and getting clicked BGR)
     const cv::Mat* original_hsv_image_ptr; // Pointer to the converted HSV image (for comparison)
     cv::Mat* display_image_ptr;          // Pointer to the image being shown (will become the mask)
+    std::vector<ColorModel::Click>* clicks_ptr; // Clicks of the current colour model (GUI thread)
+    ColorModel* model_ptr;               // Colour model compiled in a lookup table (only used by the worker thread)
+    BitMask* selection_ptr;              // Last selection, one bit per pixel (only touched by the GUI thread)
+    RegionGrow* region_grow_ptr;         // Region growing of the Ctrl+clicks (only used by the worker thread)
+    MaskWorker* worker_ptr;              // Computes the masks off the GUI thread
     std::string window_name;             // Name of the window to update (the mask window)
+
+    // Progressive mode for big images: the windows show a pyramid level, every click is first
+    // computed there and refined at full resolution when the user pauses (only used by the GUI thread)
+    const PreviewLevel* preview_ptr;         // Level shown in the windows
+    const cv::Mat* preview_hsv_image_ptr;    // HSV image at the preview level
+    RegionGrow* preview_region_grow_ptr;     // Region growing on the preview level (only used by the worker thread)
+    MaskWorker::Job refine_job;              // Full resolution job waiting for a pause
+    int64 last_click_tick = 0;
+    bool selection_pending = false;          // The full resolution selection of the last click is not ready yet
+    bool save_requested = false;             // 's' was pressed while it was not ready
+
+    SessionRecorder* recorder_ptr = nullptr; // Logs the clicks (--record)
+    bool headless = false;                   // Replay: nothing is shown
 };
 
 void click(int event, int x, int y, int flags, void* userdata);
-// Helper function for circular hue difference
-int hueDifference(int h1, int h2);
+// Mask of the clicks computed on the preview level or at full resolution
+MaskWorker::Job selectionJob(MouseCallbackData* data, const std::vector<ColorModel::Click>& clicks, const HSVTolerance& hsv_tolerance,
+                             bool grow_region, const cv::Point& seed, bool full_resolution);
+// Saves the selection as a run-length mask
+void saveSelection(const BitMask& selection);
+// Feeds a recorded session to the callback without a display and prints the latency percentiles
+int replaySession(MouseCallbackData& data, const std::string& path);
 
 int main(int argc, char** argv) {
 
-    std::string filename = "Robocup.jpg";
+    // Task4 [image] [--record <session file> | --replay <session file>]
+    std::string filename = "Robocup.jpg", record_path, replay_path;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--record" && i + 1 < argc) record_path = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc) replay_path = argv[++i];
+        else filename = arg;
+    }
 
     cv::Mat original_image = cv::imread(filename); // Load the original BGR image
     if (original_image.empty()) {
@@ -30,9 +71,27 @@ int main(int argc, char** argv) {
     cv::Mat hsv_image;
     cv::cvtColor(original_image, hsv_image, cv::COLOR_BGR2HSV);
 
+    // Colour model of the clicks, compiled in a lookup table of all the HSV colours
+    std::vector<ColorModel::Click> clicks;
+    ColorModel model;
+    // One per level, so each keeps its map of the visited pixels
+    RegionGrow region_grow, preview_region_grow;
+
+
+    // Pyramid level shown in the windows (the image itself when it is not big)
+    PreviewLevel preview(original_image.size());
+    cv::Mat preview_image, preview_hsv_image;
+    preview.downscale(original_image, preview_image);
+    if (preview.active()) {
+        cv::cvtColor(preview_image, preview_hsv_image, cv::COLOR_BGR2HSV);
+        std::cout << "Big image: previews at 1/" << (1 << preview.level()) << " resolution, refined when idle" << std::endl;
+    } else {
+        preview_hsv_image = hsv_image;
+    }
 
     // This image will hold the black/white mask output
-    cv::Mat display_image = cv::Mat::zeros(original_image.size(), original_image.type());
+    cv::Mat display_image = cv::Mat::zeros(preview.size(), original_image.type());
+    BitMask selection(original_image.rows, original_image.cols);
     std::string mask_window_title = "HSV Mask";
     std::string original_window_title = "Image";
 
@@ -42,7 +101,30 @@ int main(int argc, char** argv) {
     cb_data.original_bgr_image_ptr = &original_image; // Pass pointer to original BGR
     cb_data.original_hsv_image_ptr = &hsv_image;      // Pass pointer to converted HSV
     cb_data.display_image_ptr = &display_image;       // Pass pointer to the mask image
+    cb_data.clicks_ptr = &clicks;                     // Pass pointer to the clicks of the model
+    cb_data.model_ptr = &model;                       // Pass pointer to the compiled model
+    cb_data.selection_ptr = &selection;               // Pass pointer to the packed selection
+    cb_data.region_grow_ptr = &region_grow;           // Pass pointer to the region growing
     cb_data.window_name = mask_window_title;          // Name of the mask window
+    cb_data.preview_ptr = &preview;                   // Pass pointer to the preview level
+    cb_data.preview_hsv_image_ptr = &preview_hsv_image; // Pass pointer to the HSV preview
+    cb_data.preview_region_grow_ptr = &preview_region_grow; // Pass pointer to the region growing of the preview
+
+    // Declared after everything it uses, so it is stopped before them
+    MaskWorker worker;
+    cb_data.worker_ptr = &worker;
+
+    if (!replay_path.empty()) return replaySession(cb_data, replay_path);
+
+    SessionRecorder recorder;
+    if (!record_path.empty()) {
+        if (!recorder.open(record_path)) {
+            std::cerr << "Error: could not write " << record_path << std::endl;
+            return -1;
+        }
+        cb_data.recorder_ptr = &recorder;
+        std::cout << "Recording the session to " << record_path << std::endl;
+    }
 
     // Create windows
     cv::namedWindow(original_window_title);
@@ -51,39 +133,55 @@ int main(int argc, char** argv) {
     cv::setMouseCallback(original_window_title, click, &cb_data);
 
     // Initial display
-    cv::imshow(original_window_title, original_image); // Show original BGR
+    cv::imshow(original_window_title, preview_image); // Show original BGR (at the preview level)
     cv::imshow(mask_window_title, display_image);      // Show the initially empty mask
 
 
-    cv::waitKey(0);
+    // Show the results posted back by the worker; press 's' to save the current selection
+    // as a run-length mask, any other key to exit
+    const double refine_delay_ms = 300; // pause after the last click before refining
+    while (true) {
+        int key = cv::waitKey(10);
+        worker.poll();
+
+        // The refinement goes to the same worker, so a new click cancels it like any other job
+        double idle_ms = (cv::getTickCount() - cb_data.last_click_tick) * 1000.0 / cv::getTickFrequency();
+        if (cb_data.refine_job && (idle_ms >= refine_delay_ms || cb_data.save_requested)) {
+            worker.submit(std::move(cb_data.refine_job));
+            cb_data.refine_job = nullptr;
+        }
+
+        if (key < 0) continue;
+        if (key != 's') break;
+
+        if (cb_data.selection_pending) {
+            cb_data.save_requested = true; // saved as soon as the full resolution selection is ready
+        } else {
+            saveSelection(selection);
+        }
+    }
     cv::destroyAllWindows();
     return 0;
 }
 
-/*The point of doing this function is that hue is circular, so 178 is close to 2.*/
-int hueDifference(int h1, int h2) {
-    int diff = std::abs(h1 - h2);
-    return std::min(diff, 180 - diff); 
-}
-
 // The mouse callback function
 void click(int event, int x, int y, int flags, void* userdata) {
     if (event == cv::EVENT_LBUTTONDOWN) {
 
         MouseCallbackData* data = static_cast<MouseCallbackData*>(userdata);
-        if (!data || !data->original_bgr_image_ptr || !data->original_hsv_image_ptr || !data->display_image_ptr) {
+        if (!data || !data->original_bgr_image_ptr || !data->original_hsv_image_ptr || !data->display_image_ptr || !data->clicks_ptr || !data->model_ptr || !data->selection_ptr || !data->region_grow_ptr || !data->worker_ptr || !data->preview_ptr || !data->preview_hsv_image_ptr || !data->preview_region_grow_ptr) {
              std::cerr << "Error: Invalid userdata passed to callback." << std::endl;
              return;
         }
+        if (data->recorder_ptr) data->recorder_ptr->record("mouse", {event, x, y, flags});
 
         const cv::Mat& original_bgr_img = *(data->original_bgr_image_ptr);
-        const cv::Mat& hsv_img = *(data->original_hsv_image_ptr); // Use the pre-converted HSV image
-        cv::Mat& display_img = *(data->display_image_ptr);
-        const std::string& window_name = data->window_name;
 
+        // The window shows the preview level: back to the full resolution pixel
+        cv::Point seed = data->preview_ptr->toFull(cv::Point(x, y));
 
         //Get Clicked Color in HSV 
-        cv::Vec3b clicked_bgr_pixel = original_bgr_img.at<cv::Vec3b>(y, x);
+        cv::Vec3b clicked_bgr_pixel = original_bgr_img.at<cv::Vec3b>(seed);
 
         //Convert *this single pixel* to HSV to get the target HSV values
         cv::Mat clicked_pixel_mat(1, 1, CV_8UC3); // Create 1x1 matrix
@@ -103,30 +201,139 @@ void click(int event, int x, int y, int flags, void* userdata) {
         int v_tolerance = 135;
 
 
-        cv::Mat mask = cv::Mat::zeros(hsv_img.size(), CV_8UC3); // Output mask is BGR
-
-        //Iterate through the PRE-CONVERTED HSV image
-        for (int j = 0; j < hsv_img.rows; j++) {
-            for (int i = 0; i < hsv_img.cols; i++) {
+        HSVTolerance hsv_tolerance{h_tolerance, s_tolerance, v_tolerance};
+        bool grow_region = (flags & cv::EVENT_FLAG_CTRLKEY) != 0;
 
-                // Get the current pixel's HSV values directly from the hsv_img
-                cv::Vec3b current_hsv_pixel = hsv_img.at<cv::Vec3b>(j, i);
-                int current_h = current_hsv_pixel[0];
-                int current_s = current_hsv_pixel[1];
-                int current_v = current_hsv_pixel[2];
+        // Shift+click adds the colour to the model (to follow shading variations), a plain click starts a new model
+        std::vector<ColorModel::Click>& clicks = *(data->clicks_ptr);
+        if (!grow_region) {
+            if (!(flags & cv::EVENT_FLAG_SHIFTKEY)) clicks.clear();
+            clicks.push_back({clicked_hsv_pixel, hsv_tolerance});
+            std::cout << "Colour model: " << clicks.size() << " click(s)" << std::endl;
+        }
 
-                //Compare HSV values with tolerance
-                bool hue_ok   = hueDifference(current_h, clicked_h) <= h_tolerance;
-                bool sat_ok   = std::abs(current_s - clicked_s) <= s_tolerance;
-                bool value_ok = std::abs(current_v - clicked_v) <= v_tolerance;
+        // The mask is computed by the worker, off the GUI thread; a newer click cancels this one.
+        // Big images get a quick preview first, the full resolution job waits for a pause.
+        data->last_click_tick = cv::getTickCount();
+        data->selection_pending = true;
+        if (data->preview_ptr->active()) {
+            data->worker_ptr->submit(selectionJob(data, clicks, hsv_tolerance, grow_region, seed, false));
+            data->refine_job = selectionJob(data, clicks, hsv_tolerance, grow_region, seed, true);
+        } else {
+            data->worker_ptr->submit(selectionJob(data, clicks, hsv_tolerance, grow_region, seed, true));
+        }
+    }
+}
 
-                if (hue_ok && sat_ok && value_ok) {
-                    mask.at<cv::Vec3b>(j, i) = cv::Vec3b(255, 255, 255);
+MaskWorker::Job selectionJob(MouseCallbackData* data, const std::vector<ColorModel::Click>& clicks, const HSVTolerance& hsv_tolerance,
+                             bool grow_region, const cv::Point& seed, bool full_resolution) {
+    return [data, clicks, hsv_tolerance, grow_region, seed, full_resolution](const MaskWorker::CancelCheck& cancelled) {
+        const PreviewLevel& preview = *(data->preview_ptr);
+        // Use the pre-converted HSV image of the level
+        const cv::Mat& hsv_img = full_resolution ? *(data->original_hsv_image_ptr) : *(data->preview_hsv_image_ptr);
+        cv::Point level_seed = full_resolution ? seed : preview.toPreview(seed);
+        std::ostringstream report;
+        auto selection = std::make_shared<BitMask>();
+        if (grow_region) {
+            // Ctrl+click: grow only the connected region under the cursor, with the same HSV rules,
+            // and set its spans in the packed selection
+            RegionGrow& region_grow = full_resolution ? *(data->region_grow_ptr) : *(data->preview_region_grow_ptr);
+            Region region = region_grow.grow(hsv_img, level_seed, hsv_tolerance);
+            *selection = BitMask(hsv_img.rows, hsv_img.cols);
+            region_grow.paint(*selection);
+            report << "Region: " << region.area << " pixels, bounding box " << region.bounding_box << std::endl;
+        } else {
+            // Only the boxes of the new clicks are written in the table, then one lookup per pixel
+            ColorModel& model = *(data->model_ptr);
+            model.update(clicks);
+            int area = model.classify(hsv_img, *selection, cancelled);
+            if (area < 0) return MaskWorker::Display();
+            report << "Matched pixels: " << area << ", bounding box " << selection->boundingRect() << std::endl;
+        }
+        if (cancelled()) return MaskWorker::Display();
+
+        // The selection is unpacked only for the display
+        cv::Mat mask;
+        selection->toMat(mask);
+
+        // Split the selection in blobs (robots, balls, ...) and mark the ones that are not just noise
+        cv::Mat labels;
+        std::vector<ComponentStats> components;
+        int n_components = ConnectedComponents::label(mask, labels, components);
+        const int min_blob_area = full_resolution ? 50 : std::max(1, 50 >> (2 * preview.level()));
+
+        cv::Mat blobs;
+        cv::cvtColor(mask, blobs, cv::COLOR_GRAY2BGR);
+        report << n_components << " components, the ones with at least " << min_blob_area << " pixels:" << std::endl;
+        for (size_t i = 0; i < components.size(); i++) {
+            const ComponentStats& blob = components[i];
+            if (blob.area < min_blob_area) continue;
+            report << "  #" << i + 1 << ": area " << blob.area
+                   << ", centroid (" << blob.centroid.x << ", " << blob.centroid.y << ")"
+                   << ", bounding box " << blob.bounding_box << std::endl;
+            cv::rectangle(blobs, blob.bounding_box, cv::Scalar(0, 0, 255), 2);
+            cv::circle(blobs, cv::Point(cvRound(blob.centroid.x), cvRound(blob.centroid.y)), 3, cv::Scalar(0, 255, 0), -1);
+        }
+        // The windows show the preview level
+        if (full_resolution && preview.active()) cv::resize(blobs, blobs, preview.size(), 0, 0, cv::INTER_AREA);
+        if (cancelled()) return MaskWorker::Display();
+
+        // This part runs on the GUI thread
+        std::string text = report.str();
+        return MaskWorker::Display([data, selection, blobs, text, full_resolution]() {
+            if (full_resolution) {
+                std::cout << text;
+                *(data->selection_ptr) = std::move(*selection);
+                data->selection_pending = false;
+                if (data->save_requested) {
+                    saveSelection(*(data->selection_ptr));
+                    data->save_requested = false;
                 }
+            } else {
+                std::cout << "Preview (1/" << (1 << data->preview_ptr->level()) << " resolution, coordinates of the preview)\n" << text;
             }
+            *(data->display_image_ptr) = blobs;
+            // Refresh the mask window display
+            if (!data->headless) cv::imshow(data->window_name, blobs);
+        });
+    };
+}
+
+int replaySession(MouseCallbackData& data, const std::string& path) {
+    SessionReplayer replayer;
+    if (!replayer.load(path)) {
+        std::cerr << "Error: could not read the session " << path << std::endl;
+        return -1;
+    }
+    std::cout << "Replaying " << replayer.events().size() << " events of " << path << std::endl;
+
+    data.headless = true;
+    replayer.run([&data](const SessionEvent& event) {
+        if (event.type != "mouse" || event.values.size() != 4) return;
+        click(event.values[0], event.values[1], event.values[2], event.values[3], &data);
+    }, [&data]() {
+        data.worker_ptr->wait();
+        data.worker_ptr->poll();
+        // No pause to wait for: the full resolution refinement of a big image starts after its preview
+        if (data.refine_job) {
+            data.worker_ptr->submit(std::move(data.refine_job));
+            data.refine_job = nullptr;
+            data.worker_ptr->wait();
+            data.worker_ptr->poll();
         }
+    });
+    replayer.printReport(std::cout);
+    return 0;
+}
 
-        // Refresh the mask window display
-        cv::imshow(window_name, mask);
+void saveSelection(const BitMask& selection) {
+    cv::Mat mask;
+    selection.toMat(mask);
+    RunLengthMask rle;
+    rle.encode(mask);
+    if (rle.save("mask.rle")) {
+        std::cout << "Selection saved to mask.rle (" << rle.runs().size() << " runs)" << std::endl;
+    } else {
+        std::cerr << "Error: could not write mask.rle" << std::endl;
     }
-}
\ No newline at end of file
+}
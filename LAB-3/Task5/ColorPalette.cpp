@@ -0,0 +1,70 @@
+#include "ColorPalette.h"
+
+int ColorPalette::entryOf(const cv::Vec3b& color) const {
+    int q0 = color[0] * LEVELS / first_range;
+    int q1 = color[1] * LEVELS / 256;
+    int q2 = color[2] * LEVELS / 256;
+    return (q0 * LEVELS + q1) * LEVELS + q2;
+}
+
+void ColorPalette::build(const cv::Mat& image, int first_channel_range) {
+    CV_Assert(image.type() == CV_8UC3);
+    first_range = first_channel_range;
+
+    index.create(image.size(), CV_16UC1);
+    counts.assign(ENTRIES, 0);
+    colors.assign(ENTRIES, cv::Vec3b(0, 0, 0));
+
+    //we keep the sums to compute the mean colour of every entry at the end
+    std::vector<cv::Vec<int64, 3>> sums(ENTRIES, cv::Vec<int64, 3>(0, 0, 0));
+
+    for (int j = 0; j < image.rows; j++) {
+        const cv::Vec3b* src = image.ptr<cv::Vec3b>(j);
+        ushort* dst = index.ptr<ushort>(j);
+        for (int i = 0; i < image.cols; i++) {
+            int e = entryOf(src[i]);
+            dst[i] = (ushort)e;
+            counts[e]++;
+            sums[e][0] += src[i][0];
+            sums[e][1] += src[i][1];
+            sums[e][2] += src[i][2];
+        }
+    }
+
+    for (int e = 0; e < ENTRIES; e++) {
+        if (counts[e] > 0) {
+            colors[e] = cv::Vec3b((uchar)(sums[e][0] / counts[e]),
+                                  (uchar)(sums[e][1] / counts[e]),
+                                  (uchar)(sums[e][2] / counts[e]));
+        }
+    }
+}
+
+// How many rows are processed between two checks of the cancellation
+static const int CANCEL_CHECK_ROWS = 64;
+
+bool ColorPalette::applyLUT(const std::vector<uchar>& lut, cv::Mat& mask, const std::function<bool()>& cancelled) const {
+    mask.create(index.size(), CV_8UC1);
+    for (int j = 0; j < index.rows; j++) {
+        if (cancelled && j % CANCEL_CHECK_ROWS == 0 && cancelled()) return false;
+        const ushort* src = index.ptr<ushort>(j);
+        uchar* dst = mask.ptr<uchar>(j);
+        for (int i = 0; i < index.cols; i++) {
+            dst[i] = lut[src[i]];
+        }
+    }
+    return true;
+}
+
+bool ColorPalette::applyLUT(const std::vector<uchar>& lut, BitMask& mask, const std::function<bool()>& cancelled) const {
+    mask = BitMask(index.rows, index.cols);
+    for (int j = 0; j < index.rows; j++) {
+        if (cancelled && j % CANCEL_CHECK_ROWS == 0 && cancelled()) return false;
+        const ushort* src = index.ptr<ushort>(j);
+        uchar* dst = mask.ptr(j);
+        for (int i = 0; i < index.cols; i++) {
+            if (lut[src[i]]) dst[i >> 3] |= (uchar)(0x80 >> (i & 7));
+        }
+    }
+    return true;
+}
@@ -0,0 +1,37 @@
+#ifndef ColorTolerance_h
+#define ColorTolerance_h
+#include <opencv2/opencv.hpp>
+#include <cstdlib>
+#include <algorithm>
+
+/*The point of doing this function is that hue is circular, so 178 is close to 2.*/
+inline int hueDifference(int h1, int h2) {
+    int diff = std::abs(h1 - h2);
+    return std::min(diff, 180 - diff);
+}
+
+// Tolerance test of the BGR tools: *each* channel must be within the tolerance range
+struct BGRTolerance {
+    int tolerance;
+
+    bool operator()(const cv::Vec3b& color, const cv::Vec3b& target) const {
+        return std::abs(color[0] - target[0]) <= tolerance &&
+               std::abs(color[1] - target[1]) <= tolerance &&
+               std::abs(color[2] - target[2]) <= tolerance;
+    }
+};
+
+// Tolerance test of the HSV tools: same idea, but the hue distance is circular
+struct HSVTolerance {
+    int h_tolerance;
+    int s_tolerance;
+    int v_tolerance;
+
+    bool operator()(const cv::Vec3b& color, const cv::Vec3b& target) const {
+        return hueDifference(color[0], target[0]) <= h_tolerance &&
+               std::abs(color[1] - target[1]) <= s_tolerance &&
+               std::abs(color[2] - target[2]) <= v_tolerance;
+    }
+};
+
+#endif
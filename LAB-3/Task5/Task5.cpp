@@ -3,22 +3,50 @@
 #include <string>
 #include <cmath>
 #include <algorithm> // Needed for std::min
+#include "ColorPalette.h"
+#include "ColorTolerance.h" // hueDifference and the HSV tolerance test
+#include "MaskWorker.h"
+#include "PreviewLevel.h"
+#include "SessionLog.h"
 
 // Structure to hold the data needed by the callback
 struct MouseCallbackData {
     const cv::Mat* original_bgr_image_ptr; // Pointer to the original BGR image (for display and getting clicked BGR)
     const cv::Mat* original_hsv_image_ptr; // Pointer to the converted HSV image (for comparison)
     cv::Mat* display_image_ptr;          // Pointer to the image being shown (will become the mask)
+    const ColorPalette* palette_ptr;     // Palette index of the HSV image, built once in main
+    MaskWorker* worker_ptr;              // Computes the masks off the GUI thread
     std::string window_name;             // Name of the window to update (the mask window)
+
+    // Progressive mode for big images: the windows show a pyramid level, every click is first
+    // computed there and refined at full resolution when the user pauses (only used by the GUI thread)
+    const PreviewLevel* preview_ptr;         // Level shown in the windows
+    const cv::Mat* preview_bgr_image_ptr;    // BGR image at the preview level
+    const ColorPalette* preview_palette_ptr; // Palette index of the HSV preview
+    MaskWorker::Job refine_job;              // Full resolution job waiting for a pause
+    int64 last_click_tick = 0;
+
+    SessionRecorder* recorder_ptr = nullptr; // Logs the clicks (--record)
+    bool headless = false;                   // Replay: nothing is shown
 };
 
 void click(int event, int x, int y, int flags, void* userdata);
-// Helper function for circular hue difference
-int hueDifference(int h1, int h2);
+// Painted selection of a click computed on the preview level or at full resolution
+MaskWorker::Job maskJob(MouseCallbackData* data, const cv::Vec3b& clicked_hsv_pixel, const HSVTolerance& hsv_tolerance,
+                        bool full_resolution);
+// Feeds a recorded session to the callback without a display and prints the latency percentiles
+int replaySession(MouseCallbackData& data, const std::string& path);
 
 int main(int argc, char** argv) {
 
-    std::string filename = "Robocup.jpg";
+    // Task5 [image] [--record <session file> | --replay <session file>]
+    std::string filename = "Robocup.jpg", record_path, replay_path;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--record" && i + 1 < argc) record_path = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc) replay_path = argv[++i];
+        else filename = arg;
+    }
 
     cv::Mat original_image = cv::imread(filename); // Load the original BGR image
     if (original_image.empty()) {
@@ -30,9 +58,24 @@ int main(int argc, char** argv) {
     cv::Mat hsv_image;
     cv::cvtColor(original_image, hsv_image, cv::COLOR_BGR2HSV);
 
+    // Quantise the HSV image once (hue goes from 0 to 179), every click will only test the palette entries
+    ColorPalette palette;
+    palette.build(hsv_image, 180);
+
+    // Pyramid level shown in the windows (the image itself when it is not big), with its own palette
+    PreviewLevel preview(original_image.size());
+    cv::Mat preview_image;
+    preview.downscale(original_image, preview_image);
+    ColorPalette preview_palette;
+    if (preview.active()) {
+        cv::Mat preview_hsv_image;
+        cv::cvtColor(preview_image, preview_hsv_image, cv::COLOR_BGR2HSV);
+        preview_palette.build(preview_hsv_image, 180);
+        std::cout << "Big image: previews at 1/" << (1 << preview.level()) << " resolution, refined when idle" << std::endl;
+    }
 
     // This image will hold the black/white mask output
-    cv::Mat display_image = cv::Mat::zeros(original_image.size(), original_image.type());
+    cv::Mat display_image = cv::Mat::zeros(preview.size(), original_image.type());
     std::string mask_window_title = "HSV Mask";
     std::string original_window_title = "Image";
 
@@ -42,7 +85,27 @@ int main(int argc, char** argv) {
     cb_data.original_bgr_image_ptr = &original_image; // Pass pointer to original BGR
     cb_data.original_hsv_image_ptr = &hsv_image;      // Pass pointer to converted HSV
     cb_data.display_image_ptr = &display_image;       // Pass pointer to the mask image
+    cb_data.palette_ptr = &palette;                   // Pass pointer to the palette index
     cb_data.window_name = mask_window_title;          // Name of the mask window
+    cb_data.preview_ptr = &preview;                   // Pass pointer to the preview level
+    cb_data.preview_bgr_image_ptr = &preview_image;   // Pass pointer to the BGR preview
+    cb_data.preview_palette_ptr = preview.active() ? &preview_palette : &palette; // and to its palette
+
+    // Declared after everything it uses, so it is stopped before them
+    MaskWorker worker;
+    cb_data.worker_ptr = &worker;
+
+    if (!replay_path.empty()) return replaySession(cb_data, replay_path);
+
+    SessionRecorder recorder;
+    if (!record_path.empty()) {
+        if (!recorder.open(record_path)) {
+            std::cerr << "Error: could not write " << record_path << std::endl;
+            return -1;
+        }
+        cb_data.recorder_ptr = &recorder;
+        std::cout << "Recording the session to " << record_path << std::endl;
+    }
 
     // Create windows
     cv::namedWindow(original_window_title);
@@ -51,39 +114,44 @@ int main(int argc, char** argv) {
     cv::setMouseCallback(original_window_title, click, &cb_data);
 
     // Initial display
-    cv::imshow(original_window_title, original_image); // Show original BGR
+    cv::imshow(original_window_title, preview_image); // Show original BGR (at the preview level)
     cv::imshow(mask_window_title, display_image);      // Show the initially empty mask
 
 
-    cv::waitKey(0);
+    // Show the results posted back by the worker until a key is pressed
+    const double refine_delay_ms = 300; // pause after the last click before refining
+    while (cv::waitKey(10) < 0) {
+        worker.poll();
+
+        // The refinement goes to the same worker, so a new click cancels it like any other job
+        double idle_ms = (cv::getTickCount() - cb_data.last_click_tick) * 1000.0 / cv::getTickFrequency();
+        if (cb_data.refine_job && idle_ms >= refine_delay_ms) {
+            worker.submit(std::move(cb_data.refine_job));
+            cb_data.refine_job = nullptr;
+        }
+    }
     cv::destroyAllWindows();
     return 0;
 }
 
-/*The point of doing this function is that hue is circular, so 178 is close to 2.*/
-int hueDifference(int h1, int h2) {
-    int diff = std::abs(h1 - h2);
-    return std::min(diff, 180 - diff); 
-}
-
 // The mouse callback function
 void click(int event, int x, int y, int flags, void* userdata) {
     if (event == cv::EVENT_LBUTTONDOWN) {
 
         MouseCallbackData* data = static_cast<MouseCallbackData*>(userdata);
-        if (!data || !data->original_bgr_image_ptr || !data->original_hsv_image_ptr || !data->display_image_ptr) {
+        if (!data || !data->original_bgr_image_ptr || !data->original_hsv_image_ptr || !data->display_image_ptr || !data->palette_ptr || !data->worker_ptr || !data->preview_ptr || !data->preview_bgr_image_ptr || !data->preview_palette_ptr) {
              std::cerr << "Error: Invalid userdata passed to callback." << std::endl;
              return;
         }
+        if (data->recorder_ptr) data->recorder_ptr->record("mouse", {event, x, y, flags});
 
         const cv::Mat& original_bgr_img = *(data->original_bgr_image_ptr);
-        const cv::Mat& hsv_img = *(data->original_hsv_image_ptr); // Use the pre-converted HSV image
-        cv::Mat& display_img = *(data->display_image_ptr);
-        const std::string& window_name = data->window_name;
 
 
         //Get Clicked Color in HSV 
-        cv::Vec3b clicked_bgr_pixel = original_bgr_img.at<cv::Vec3b>(y, x);
+        // The window shows the preview level: back to the full resolution pixel
+        cv::Point seed = data->preview_ptr->toFull(cv::Point(x, y));
+        cv::Vec3b clicked_bgr_pixel = original_bgr_img.at<cv::Vec3b>(seed);
 
         //Convert *this single pixel* to HSV to get the target HSV values
         cv::Mat clicked_pixel_mat(1, 1, CV_8UC3); // Create 1x1 matrix
@@ -103,30 +171,71 @@ void click(int event, int x, int y, int flags, void* userdata) {
         int v_tolerance = 135;
 
 
-        cv::Mat mask = original_bgr_img.clone();
-
-        //Iterate through the PRE-CONVERTED HSV image
-        for (int j = 0; j < hsv_img.rows; j++) {
-            for (int i = 0; i < hsv_img.cols; i++) {
+        HSVTolerance hsv_tolerance{h_tolerance, s_tolerance, v_tolerance};
 
-                // Get the current pixel's HSV values directly from the hsv_img
-                cv::Vec3b current_hsv_pixel = hsv_img.at<cv::Vec3b>(j, i);
-                int current_h = current_hsv_pixel[0];
-                int current_s = current_hsv_pixel[1];
-                int current_v = current_hsv_pixel[2];
-
-                //Compare HSV values with tolerance
-                bool hue_ok   = hueDifference(current_h, clicked_h) <= h_tolerance;
-                bool sat_ok   = std::abs(current_s - clicked_s) <= s_tolerance;
-                bool value_ok = std::abs(current_v - clicked_v) <= v_tolerance;
-
-                if (hue_ok && sat_ok && value_ok) {
-                    mask.at<cv::Vec3b>(j, i) = cv::Vec3b(92, 37, 201);
-                }
-            }
+        // The mask is computed by the worker, off the GUI thread; a newer click cancels this one.
+        // Big images get a quick preview first, the full resolution job waits for a pause.
+        data->last_click_tick = cv::getTickCount();
+        if (data->preview_ptr->active()) {
+            data->worker_ptr->submit(maskJob(data, clicked_hsv_pixel, hsv_tolerance, false));
+            data->refine_job = maskJob(data, clicked_hsv_pixel, hsv_tolerance, true);
+        } else {
+            data->worker_ptr->submit(maskJob(data, clicked_hsv_pixel, hsv_tolerance, true));
         }
+    }
+}
+
+MaskWorker::Job maskJob(MouseCallbackData* data, const cv::Vec3b& clicked_hsv_pixel, const HSVTolerance& hsv_tolerance,
+                        bool full_resolution) {
+    return [data, clicked_hsv_pixel, hsv_tolerance, full_resolution](const MaskWorker::CancelCheck& cancelled) {
+        const PreviewLevel& preview = *(data->preview_ptr);
+        const ColorPalette& palette = full_resolution ? *(data->palette_ptr) : *(data->preview_palette_ptr);
+
+        // Test the tolerances on the palette entries of the level
+        cv::Mat selected;
+        int area = palette.select(clicked_hsv_pixel, hsv_tolerance, selected, cancelled);
+        if (area < 0) return MaskWorker::Display();
+
+        // The windows show the preview level: the selected pixels are painted there
+        if (full_resolution) preview.downscaleMask(selected, selected);
+        cv::Mat mask = data->preview_bgr_image_ptr->clone();
+        mask.setTo(cv::Scalar(92, 37, 201), selected);
+        if (cancelled()) return MaskWorker::Display();
+
+        // This part runs on the GUI thread
+        return MaskWorker::Display([data, mask, area, full_resolution]() {
+            if (!full_resolution) std::cout << "Preview (1/" << (1 << data->preview_ptr->level()) << " resolution) ";
+            std::cout << "Matched pixels: " << area << std::endl;
+            *(data->display_image_ptr) = mask;
+            // Refresh the mask window display
+            if (!data->headless) cv::imshow(data->window_name, mask);
+        });
+    };
+}
 
-        // Refresh the mask window display
-        cv::imshow(window_name, mask);
+int replaySession(MouseCallbackData& data, const std::string& path) {
+    SessionReplayer replayer;
+    if (!replayer.load(path)) {
+        std::cerr << "Error: could not read the session " << path << std::endl;
+        return -1;
     }
+    std::cout << "Replaying " << replayer.events().size() << " events of " << path << std::endl;
+
+    data.headless = true;
+    replayer.run([&data](const SessionEvent& event) {
+        if (event.type != "mouse" || event.values.size() != 4) return;
+        click(event.values[0], event.values[1], event.values[2], event.values[3], &data);
+    }, [&data]() {
+        data.worker_ptr->wait();
+        data.worker_ptr->poll();
+        // No pause to wait for: the full resolution refinement of a big image starts after its preview
+        if (data.refine_job) {
+            data.worker_ptr->submit(std::move(data.refine_job));
+            data.refine_job = nullptr;
+            data.worker_ptr->wait();
+            data.worker_ptr->poll();
+        }
+    });
+    replayer.printReport(std::cout);
+    return 0;
 }
\ No newline at end of file
@@ -0,0 +1,229 @@
+#include "EdgeDetector.h"
+#include <vector>
+#include <algorithm>
+
+namespace {
+
+// Union-find where the root is always the smallest label (same as in the connected components of LAB-3)
+int findRoot(std::vector<int>& parent, int label) {
+    while (parent[label] != label) {
+        parent[label] = parent[parent[label]]; // path halving
+        label = parent[label];
+    }
+    return label;
+}
+
+int merge(std::vector<int>& parent, int a, int b) {
+    int root_a = findRoot(parent, a);
+    int root_b = findRoot(parent, b);
+    if (root_a < root_b) {
+        parent[root_b] = root_a;
+        return root_a;
+    }
+    parent[root_a] = root_b;
+    return root_b;
+}
+
+}
+
+EdgeDetector::EdgeDetector(const cv::Mat& gray) : gray(gray) {
+    CV_Assert(gray.type() == CV_8UC1);
+}
+
+void EdgeDetector::detect(double low_threshold, double high_threshold, int aperture_size, cv::Mat& edges, int bands) {
+    // Same conventions of cv::Canny with the L1 gradient
+    if (low_threshold > high_threshold) std::swap(low_threshold, high_threshold);
+    if (aperture_size == 7) {
+        // the 7x7 gradient is scaled by 1/16 (see Gradient)
+        low_threshold /= 16;
+        high_threshold /= 16;
+    }
+    int low = cvFloor(low_threshold);
+    int high = cvFloor(high_threshold);
+
+    const cv::Mat& suppressed = stage(aperture_size).suppressed;
+    if (bands <= 0) bands = cv::getNumThreads();
+    bands = std::max(1, std::min(bands, suppressed.rows));
+    if (bands == 1) {
+        hysteresis(suppressed, low, high, edges);
+    } else {
+        parallelHysteresis(suppressed, low, high, edges, bands);
+    }
+}
+
+const Gradient& EdgeDetector::gradient(int aperture_size) {
+    return stage(aperture_size).gradient;
+}
+
+EdgeDetector::Stage& EdgeDetector::stage(int aperture_size) {
+    auto cached = cache.find(aperture_size);
+    if (cached != cache.end()) return cached->second;
+
+    Stage& stage = cache[aperture_size];
+    Gradient::compute(gray, stage.gradient, aperture_size);
+    suppress(stage.gradient, stage.suppressed);
+    return stage;
+}
+
+void EdgeDetector::suppress(const Gradient& gradient, cv::Mat& suppressed) {
+    const int rows = gradient.magnitude.rows, cols = gradient.magnitude.cols;
+
+    // Magnitude with a border of zeros all around, so the neighbours never go out of the image
+    cv::Mat magnitude;
+    cv::copyMakeBorder(gradient.magnitude, magnitude, 1, 1, 1, 1, cv::BORDER_CONSTANT, cv::Scalar(0));
+
+    // Same comparisons and tie breaking of cv::Canny for each direction sector
+    suppressed = cv::Mat::zeros(rows, cols, CV_32SC1);
+    for (int j = 0; j < rows; j++) {
+        const int* previous = magnitude.ptr<int>(j) + 1;
+        const int* current = magnitude.ptr<int>(j + 1) + 1;
+        const int* next = magnitude.ptr<int>(j + 2) + 1;
+        const uchar* direction = gradient.orientation.ptr<uchar>(j);
+        int* dst = suppressed.ptr<int>(j);
+
+        for (int i = 0; i < cols; i++) {
+            int m = current[i];
+            if (m == 0) continue;
+
+            bool is_max;
+            switch (direction[i]) {
+                case Gradient::HORIZONTAL: is_max = m > current[i - 1] && m >= current[i + 1]; break;
+                case Gradient::VERTICAL: is_max = m > previous[i] && m >= next[i]; break;
+                case Gradient::DIAGONAL: is_max = m > previous[i - 1] && m > next[i + 1]; break;
+                default: is_max = m > previous[i + 1] && m > next[i - 1]; break;
+            }
+            if (is_max) dst[i] = m;
+        }
+    }
+}
+
+void EdgeDetector::hysteresis(const cv::Mat& suppressed, int low, int high, cv::Mat& edges) {
+    const int rows = suppressed.rows, cols = suppressed.cols;
+    edges = cv::Mat::zeros(rows, cols, CV_8UC1);
+
+    // Every strong pixel (> high) starts a flood through the weak ones (> low), 8-connectivity
+    std::vector<cv::Point> stack;
+    for (int j = 0; j < rows; j++) {
+        const int* m = suppressed.ptr<int>(j);
+        uchar* e = edges.ptr<uchar>(j);
+        for (int i = 0; i < cols; i++) {
+            if (m[i] <= high || e[i]) continue;
+            e[i] = 255;
+            stack.push_back(cv::Point(i, j));
+
+            while (!stack.empty()) {
+                cv::Point p = stack.back();
+                stack.pop_back();
+                for (int ny = std::max(0, p.y - 1); ny <= std::min(rows - 1, p.y + 1); ny++) {
+                    const int* m_row = suppressed.ptr<int>(ny);
+                    uchar* e_row = edges.ptr<uchar>(ny);
+                    for (int nx = std::max(0, p.x - 1); nx <= std::min(cols - 1, p.x + 1); nx++) {
+                        if (m_row[nx] > low && !e_row[nx]) {
+                            e_row[nx] = 255;
+                            stack.push_back(cv::Point(nx, ny));
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*
+Same result of the flood fill, seen as connected components: a pixel is an edge when it is a weak
+pixel (> low) whose 8-connected component of weak pixels contains at least one strong pixel (> high).
+Every band labels its weak pixels with the two-pass union-find and marks the labels that have a
+strong pixel; then the labels that touch across the band boundaries are merged, the strong mark
+goes up to the roots and a last parallel pass keeps the pixels whose root is marked.
+*/
+void EdgeDetector::parallelHysteresis(const cv::Mat& suppressed, int low, int high, cv::Mat& edges, int bands) {
+    const int rows = suppressed.rows, cols = suppressed.cols;
+    edges.create(rows, cols, CV_8UC1);
+
+    // With 8-connectivity a row can start at most (cols + 1) / 2 new labels, so every band has its own range
+    const int labels_per_row = (cols + 1) / 2;
+    std::vector<int> band_start(bands + 1);
+    for (int b = 0; b <= bands; b++) band_start[b] = (int)((int64)rows * b / bands);
+
+    cv::Mat labels(rows, cols, CV_32SC1);
+    std::vector<int> parent((size_t)rows * labels_per_row + 1, 0);
+    std::vector<uchar> strong(parent.size(), 0);
+    std::vector<int> next_label(bands);
+
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range) {
+        for (int b = range.start; b < range.end; b++) {
+            const int first_row = band_start[b], last_row = band_start[b + 1];
+            int next = first_row * labels_per_row + 1;
+
+            for (int y = first_row; y < last_row; y++) {
+                const int* m = suppressed.ptr<int>(y);
+                int* dst = labels.ptr<int>(y);
+                const int* above = (y > first_row) ? labels.ptr<int>(y - 1) : nullptr;
+
+                for (int x = 0; x < cols; x++) {
+                    if (m[x] <= low) {
+                        dst[x] = 0;
+                        continue;
+                    }
+
+                    // already scanned neighbours: left, up-left, up, up-right
+                    int neighbours[4] = {
+                        x > 0 ? dst[x - 1] : 0,
+                        above && x > 0 ? above[x - 1] : 0,
+                        above ? above[x] : 0,
+                        above && x < cols - 1 ? above[x + 1] : 0
+                    };
+
+                    int current = 0;
+                    for (int n : neighbours) {
+                        if (!n) continue;
+                        current = current ? merge(parent, current, n) : n;
+                    }
+                    if (!current) {
+                        current = next++;
+                        parent[current] = current;
+                    }
+                    dst[x] = current;
+                    if (m[x] > high) strong[current] = 1;
+                }
+            }
+            next_label[b] = next;
+        }
+    });
+
+    // Merge the labels that touch across the band boundaries
+    for (int b = 1; b < bands; b++) {
+        const int y = band_start[b];
+        const int* row = labels.ptr<int>(y);
+        const int* above = labels.ptr<int>(y - 1);
+        for (int x = 0; x < cols; x++) {
+            if (!row[x]) continue;
+            for (int dx = -1; dx <= 1; dx++) {
+                if (x + dx >= 0 && x + dx < cols && above[x + dx]) merge(parent, row[x], above[x + dx]);
+            }
+        }
+    }
+
+    // A component is kept if any of its labels has a strong pixel: first collect the marks on the roots,
+    // then every label reads the mark of its root (label 0, the background, is never kept)
+    for (int b = 0; b < bands; b++) {
+        for (int l = band_start[b] * labels_per_row + 1; l < next_label[b]; l++) {
+            if (strong[l]) strong[findRoot(parent, l)] = 1;
+        }
+    }
+    for (int b = 0; b < bands; b++) {
+        for (int l = band_start[b] * labels_per_row + 1; l < next_label[b]; l++) {
+            strong[l] = strong[findRoot(parent, l)];
+        }
+    }
+
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range) {
+        for (int y = band_start[range.start]; y < band_start[range.end]; y++) {
+            const int* l = labels.ptr<int>(y);
+            uchar* e = edges.ptr<uchar>(y);
+            for (int x = 0; x < cols; x++) {
+                e[x] = strong[l[x]] ? 255 : 0;
+            }
+        }
+    });
+}
@@ -0,0 +1,40 @@
+#ifndef EdgeDetector_h
+#define EdgeDetector_h
+#include <opencv2/opencv.hpp>
+#include <map>
+#include "Gradient.h"
+
+/*
+Canny edge detector that remembers its intermediate results.
+The Sobel gradients, the magnitude and the non-maximum suppression do not depend on the
+thresholds, so they are computed once per aperture size and cached: when only the low/high
+thresholds change, only the hysteresis runs again.
+The hysteresis itself runs in parallel on horizontal bands of the image (see parallelHysteresis).
+The result is the same as cv::Canny(gray, edges, low, high, aperture_size) with the L1 gradient.
+*/
+class EdgeDetector {
+    public:
+    explicit EdgeDetector(const cv::Mat& gray);
+
+    // bands = 0 means one band per thread, 1 is the serial flood fill
+    void detect(double low_threshold, double high_threshold, int aperture_size, cv::Mat& edges, int bands = 0);
+
+    // The cached gradient, so the other stages working on the same image do not recompute it
+    const Gradient& gradient(int aperture_size);
+
+    private:
+    struct Stage {
+        Gradient gradient;
+        cv::Mat suppressed; // CV_32SC1: the magnitude where the pixel is a local maximum along the gradient, 0 elsewhere
+    };
+
+    Stage& stage(int aperture_size);
+    static void suppress(const Gradient& gradient, cv::Mat& suppressed);
+    static void hysteresis(const cv::Mat& suppressed, int low, int high, cv::Mat& edges);
+    static void parallelHysteresis(const cv::Mat& suppressed, int low, int high, cv::Mat& edges, int bands);
+
+    cv::Mat gray;
+    std::map<int, Stage> cache; // aperture size -> gradient and suppressed magnitude
+};
+
+#endif
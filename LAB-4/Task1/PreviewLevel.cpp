@@ -0,0 +1,42 @@
+#include "PreviewLevel.h"
+#include <algorithm>
+
+PreviewLevel::PreviewLevel(const cv::Size& full_size) : full_size(full_size), preview_size(full_size) {
+    if (std::max(full_size.width, full_size.height) <= LARGE_SIDE) return;
+
+    // Same sizes of cv::pyrDown
+    while (std::max(preview_size.width, preview_size.height) > PREVIEW_SIDE) {
+        preview_size = cv::Size((preview_size.width + 1) / 2, (preview_size.height + 1) / 2);
+        pyramid_level++;
+    }
+}
+
+void PreviewLevel::downscale(const cv::Mat& full, cv::Mat& preview) const {
+    preview = full;
+    for (int l = 0; l < pyramid_level; l++) cv::pyrDown(preview, preview);
+}
+
+void PreviewLevel::downscaleMask(const cv::Mat& full, cv::Mat& preview) const {
+    if (!active()) {
+        preview = full;
+        return;
+    }
+    cv::resize(full, preview, preview_size, 0, 0, cv::INTER_AREA);
+    cv::threshold(preview, preview, 0, 255, cv::THRESH_BINARY);
+}
+
+int PreviewLevel::mapCoordinate(int value, int from, int to) {
+    // centre of the pixel in the other grid
+    int mapped = cvFloor((value + 0.5) * to / from);
+    return std::max(0, std::min(to - 1, mapped));
+}
+
+cv::Point PreviewLevel::toFull(const cv::Point& p) const {
+    return cv::Point(mapCoordinate(p.x, preview_size.width, full_size.width),
+                     mapCoordinate(p.y, preview_size.height, full_size.height));
+}
+
+cv::Point PreviewLevel::toPreview(const cv::Point& p) const {
+    return cv::Point(mapCoordinate(p.x, full_size.width, preview_size.width),
+                     mapCoordinate(p.y, full_size.height, preview_size.height));
+}
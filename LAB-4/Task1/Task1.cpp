@@ -1,11 +1,49 @@
 #include <opencv2/opencv.hpp>
 #include <iostream>
+#include <string>
+#include <filesystem>
+#include "RunLengthMask.h"
+#include "EdgeDetector.h"
+#include "PreviewLevel.h"
+#include "MaskWorker.h"
+#include "SessionLog.h"
+
+// Data needed by the trackbar callback
+struct TrackbarData {
+    EdgeDetector* detector_ptr;          // Full resolution detector (only used by the worker thread on big images)
+    EdgeDetector* preview_detector_ptr;  // Detector of the preview level (GUI thread)
+    const PreviewLevel* preview_ptr;     // Level shown in the window
+    int* low_threshold_ptr;
+    int* high_threshold_ptr;
+    int* kernel_size_ptr;
+    cv::Mat* edges_ptr;                  // Last full resolution edge map
+    MaskWorker* worker_ptr;              // Refines the preview at full resolution
+    SessionRecorder* recorder_ptr = nullptr; // Logs the slider changes (--record)
+    bool headless = false;               // Replay: the values are set by the replayer and nothing is shown
+
+    // Progressive mode for big images (GUI thread only)
+    MaskWorker::Job refine_job;          // Full resolution job waiting for a pause
+    int64 last_change_tick = 0;
+    bool edges_pending = false;          // The full resolution edges of the last change are not ready yet
+    bool archive_requested = false;      // 's' was pressed while they were not ready
+};
 
 // Callback function to update the Canny edge detection
 void on_trackbar(int, void* userdata);
+// Saves the edge map both as run-length file and as PNG and compares size and loading time
+void archiveEdges(const cv::Mat& edges);
+// Feeds a recorded session to the callback without a display and prints the latency percentiles
+int replaySession(TrackbarData& params, const std::string& path);
 
 int main(int argc, char** argv) {
-    std::string filename = "street_scene.png";
+    // Task1 [image] [--record <session file> | --replay <session file>]
+    std::string filename = "street_scene.png", record_path, replay_path;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--record" && i + 1 < argc) record_path = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc) replay_path = argv[++i];
+        else filename = arg;
+    }
 
     cv::Mat original_image = cv::imread(filename); // Load the original BGR image
     if (original_image.empty()) {
@@ -16,16 +54,53 @@ int main(int argc, char** argv) {
     cv::Mat gray_image;
     cv::cvtColor(original_image, gray_image, cv::COLOR_BGR2GRAY); // Convert to grayscale
 
+    // Keeps the gradients of the image, so moving a threshold slider only redoes the hysteresis
+    EdgeDetector detector(gray_image);
+
+    // Big images are shown on a pyramid level: a slider change is first computed there,
+    // and the full resolution edges are computed in the background when the user pauses
+    PreviewLevel preview(gray_image.size());
+    cv::Mat preview_gray;
+    preview.downscale(gray_image, preview_gray);
+    EdgeDetector preview_detector(preview_gray);
+    if (preview.active()) {
+        std::cout << "Big image: previews at 1/" << (1 << preview.level()) << " resolution, refined when idle" << std::endl;
+    }
+
     int low_threshold = 50;
     int high_threshold = 150;
     int kernel_size = 3;
+    cv::Mat edges; // last edge map, updated by the callback
+
+    // Declared after everything it uses, so it is stopped before them
+    MaskWorker worker;
+
+    // Bundle parameters for the callback
+    TrackbarData params;
+    params.detector_ptr = &detector;
+    params.preview_detector_ptr = &preview_detector;
+    params.preview_ptr = &preview;
+    params.low_threshold_ptr = &low_threshold;
+    params.high_threshold_ptr = &high_threshold;
+    params.kernel_size_ptr = &kernel_size;
+    params.edges_ptr = &edges;
+    params.worker_ptr = &worker;
+
+    if (!replay_path.empty()) return replaySession(params, replay_path);
+
+    SessionRecorder recorder;
+    if (!record_path.empty()) {
+        if (!recorder.open(record_path)) {
+            std::cerr << "Error: could not write " << record_path << std::endl;
+            return -1;
+        }
+        params.recorder_ptr = &recorder;
+        std::cout << "Recording the session to " << record_path << std::endl;
+    }
 
     // Create a window to display the Canny edge detection
     cv::namedWindow("Canny Edge Detection", cv::WINDOW_AUTOSIZE);
 
-    // Bundle parameters into a tuple for the callback
-    auto params = std::make_tuple(&gray_image, &low_threshold, &high_threshold, &kernel_size);
-
     // Create trackbars to control the Canny parameters
     cv::createTrackbar("Low Threshold", "Canny Edge Detection", nullptr, 255, on_trackbar, &params);
     cv::createTrackbar("High Threshold", "Canny Edge Detection", nullptr, 255, on_trackbar, &params);
@@ -39,29 +114,163 @@ int main(int argc, char** argv) {
     // Initial call to display the Canny edge detection
     on_trackbar(0, &params);
 
-    cv::imshow("Original Image", original_image);
+    cv::Mat preview_image;
+    preview.downscale(original_image, preview_image);
+    cv::imshow("Original Image", preview_image);
+
+    // Press 's' to archive the current edge map, any other key to exit
+    const double refine_delay_ms = 300; // pause after the last slider change before refining
+    while (true) {
+        int key = cv::waitKey(10);
+        worker.poll();
 
-    cv::waitKey(0);
+        // A newer slider change cancels the refinement in flight, like any other job of the worker
+        double idle_ms = (cv::getTickCount() - params.last_change_tick) * 1000.0 / cv::getTickFrequency();
+        if (params.refine_job && (idle_ms >= refine_delay_ms || params.archive_requested)) {
+            worker.submit(std::move(params.refine_job));
+            params.refine_job = nullptr;
+        }
+
+        if (key < 0) continue;
+        if (key != 's') break;
+        if (params.edges_pending) {
+            params.archive_requested = true; // archived as soon as the full resolution edges are ready
+        } else {
+            archiveEdges(edges);
+        }
+    }
     cv::destroyAllWindows();
     return 0;
 }
 
 void on_trackbar(int, void* userdata) {
-    auto params = static_cast<std::tuple<cv::Mat*, int*, int*, int*>*>(userdata);
-    cv::Mat* gray_image = std::get<0>(*params);
-    int* low_threshold = std::get<1>(*params);
-    int* high_threshold = std::get<2>(*params);
-    int* kernel_size = std::get<3>(*params);
+    TrackbarData* params = static_cast<TrackbarData*>(userdata);
+    int* low_threshold = params->low_threshold_ptr;
+    int* high_threshold = params->high_threshold_ptr;
+    int* kernel_size = params->kernel_size_ptr;
 
-    // Fetch updated trackbar values
-    *low_threshold = cv::getTrackbarPos("Low Threshold", "Canny Edge Detection");
-    *high_threshold = cv::getTrackbarPos("High Threshold", "Canny Edge Detection");
-    *kernel_size = cv::getTrackbarPos("Kernel Size", "Canny Edge Detection");
+    // Fetch updated trackbar values (the replayer has already set them)
+    if (!params->headless) {
+        *low_threshold = cv::getTrackbarPos("Low Threshold", "Canny Edge Detection");
+        *high_threshold = cv::getTrackbarPos("High Threshold", "Canny Edge Detection");
+        *kernel_size = cv::getTrackbarPos("Kernel Size", "Canny Edge Detection");
+    }
+    if (params->recorder_ptr) params->recorder_ptr->record("trackbar", {*low_threshold, *high_threshold, *kernel_size});
 
     // Ensure kernel size is odd and at least 3
     *kernel_size = std::max(3, *kernel_size | 1);
 
-    cv::Mat edges;
-    cv::Canny(*gray_image, edges, *low_threshold, *high_threshold, *kernel_size);
-    cv::imshow("Canny Edge Detection", edges);
+    const PreviewLevel& preview = *(params->preview_ptr);
+    if (!preview.active()) {
+        cv::TickMeter timer;
+        timer.start();
+        params->detector_ptr->detect(*low_threshold, *high_threshold, *kernel_size, *(params->edges_ptr));
+        timer.stop();
+        std::cout << "Canny (" << *low_threshold << ", " << *high_threshold << ", " << *kernel_size << "): "
+                  << timer.getTimeMilli() << " ms" << std::endl;
+        if (!params->headless) cv::imshow("Canny Edge Detection", *(params->edges_ptr));
+        return;
+    }
+
+    // Preview now, on the GUI thread
+    cv::Mat preview_edges;
+    cv::TickMeter timer;
+    timer.start();
+    params->preview_detector_ptr->detect(*low_threshold, *high_threshold, *kernel_size, preview_edges);
+    timer.stop();
+    std::cout << "Canny preview (" << *low_threshold << ", " << *high_threshold << ", " << *kernel_size << "): "
+              << timer.getTimeMilli() << " ms" << std::endl;
+    if (!params->headless) cv::imshow("Canny Edge Detection", preview_edges);
+
+    // Full resolution later, on the worker
+    int low = *low_threshold, high = *high_threshold, aperture = *kernel_size;
+    params->last_change_tick = cv::getTickCount();
+    params->edges_pending = true;
+    params->refine_job = [params, low, high, aperture](const MaskWorker::CancelCheck& cancelled) {
+        EdgeDetector& detector = *(params->detector_ptr);
+        detector.gradient(aperture); // the expensive part when the aperture is new, then a chance to give up
+        if (cancelled()) return MaskWorker::Display();
+
+        auto full_edges = std::make_shared<cv::Mat>();
+        detector.detect(low, high, aperture, *full_edges);
+        cv::Mat shown;
+        params->preview_ptr->downscaleMask(*full_edges, shown);
+        if (cancelled()) return MaskWorker::Display();
+
+        // This part runs on the GUI thread
+        return MaskWorker::Display([params, low, high, aperture, full_edges, shown]() {
+            // The preview runs on the GUI thread and does not cancel the job: the sliders may have moved since
+            if (low != *(params->low_threshold_ptr) || high != *(params->high_threshold_ptr) || aperture != *(params->kernel_size_ptr)) return;
+            *(params->edges_ptr) = *full_edges;
+            params->edges_pending = false;
+            if (!params->headless) cv::imshow("Canny Edge Detection", shown);
+            if (params->archive_requested) {
+                archiveEdges(*full_edges);
+                params->archive_requested = false;
+            }
+        });
+    };
+}
+
+int replaySession(TrackbarData& params, const std::string& path) {
+    SessionReplayer replayer;
+    if (!replayer.load(path)) {
+        std::cerr << "Error: could not read the session " << path << std::endl;
+        return -1;
+    }
+    std::cout << "Replaying " << replayer.events().size() << " events of " << path << std::endl;
+
+    params.headless = true;
+    replayer.run([&params](const SessionEvent& event) {
+        if (event.type != "trackbar" || event.values.size() != 3) return;
+        *(params.low_threshold_ptr) = event.values[0];
+        *(params.high_threshold_ptr) = event.values[1];
+        *(params.kernel_size_ptr) = event.values[2];
+        on_trackbar(0, &params);
+    }, [&params]() {
+        // No pause to wait for: the full resolution refinement of a big image starts right away
+        if (params.refine_job) {
+            params.worker_ptr->submit(std::move(params.refine_job));
+            params.refine_job = nullptr;
+        }
+        params.worker_ptr->wait();
+        params.worker_ptr->poll();
+    });
+    replayer.printReport(std::cout);
+    return 0;
+}
+
+void archiveEdges(const cv::Mat& edges) {
+    const std::string rle_path = "edges.rle";
+    const std::string png_path = "edges.png";
+
+    RunLengthMask rle;
+    rle.encode(edges);
+    if (!rle.save(rle_path) || !cv::imwrite(png_path, edges)) {
+        std::cerr << "Error: could not write the edge map" << std::endl;
+        return;
+    }
+
+    // Time the loading of both files back into a cv::Mat
+    cv::TickMeter png_timer, rle_timer;
+    png_timer.start();
+    cv::Mat from_png = cv::imread(png_path, cv::IMREAD_GRAYSCALE);
+    png_timer.stop();
+    rle_timer.start();
+    RunLengthMask loaded;
+    cv::Mat from_rle;
+    bool ok = loaded.load(rle_path);
+    if (ok) loaded.decode(from_rle);
+    rle_timer.stop();
+    if (!ok || from_png.empty()) {
+        std::cerr << "Error: could not read the edge map back" << std::endl;
+        return;
+    }
+
+    auto rle_bytes = std::filesystem::file_size(rle_path);
+    auto png_bytes = std::filesystem::file_size(png_path);
+    std::cout << "Edge map archived: " << rle.runs().size() << " runs\n"
+              << "  " << rle_path << ": " << rle_bytes << " bytes, loaded in " << rle_timer.getTimeMilli() << " ms\n"
+              << "  " << png_path << ": " << png_bytes << " bytes, loaded in " << png_timer.getTimeMilli() << " ms\n"
+              << "  size ratio PNG/RLE: " << (double)png_bytes / rle_bytes << std::endl;
 }
\ No newline at end of file
@@ -0,0 +1,159 @@
+#include "LaneTracker.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    const double SEARCH_WINDOW = 5 * CV_PI / 180.0; // around the nominal angles, same as the still image
+    const double TRACK_WINDOW = 2 * CV_PI / 180.0;  // around the predicted angle
+    const int BAND_HALF_WIDTH = 15;                 // pixels on each side of the predicted line
+    const int STRIP_SIZE = 32;                      // rows (or columns) of every Canny strip of the band
+    const int STRIP_MARGIN = 2;                     // context for the gradients at the borders of a strip
+    const int MAX_MISSED_FRAMES = 5;                // then the line is searched in the whole frame again
+    const int CANNY_LOW = 250, CANNY_HIGH = 250;    // same thresholds of the still image
+}
+
+LaneTracker::LaneTracker(double angle1_deg, double angle2_deg, int hough_threshold)
+    : tracks(2), hough_threshold(hough_threshold) {
+    tracks[0].nominal_angle = angle1_deg * CV_PI / 180.0;
+    tracks[1].nominal_angle = angle2_deg * CV_PI / 180.0;
+}
+
+bool LaneTracker::process(const cv::Mat& frame, cv::Vec2f& line1, cv::Vec2f& line2, bool& full_search) {
+    cv::Mat gray;
+    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+
+    // The tracked lines are followed in their band, the whole frame is searched only for the lost ones
+    for (Track& track : tracks) {
+        if (track.active) trackLine(gray, track);
+    }
+    full_search = !tracks[0].active || !tracks[1].active;
+    if (full_search) fullSearch(gray);
+
+    if (!tracks[0].active || !tracks[1].active) return false;
+    line1 = state(tracks[0]);
+    line2 = state(tracks[1]);
+    return true;
+}
+
+void LaneTracker::fullSearch(const cv::Mat& gray) {
+    cv::Mat edges;
+    cv::Canny(gray, edges, CANNY_LOW, CANNY_HIGH, 3);
+
+    std::vector<ThetaRange> ranges;
+    for (const Track& track : tracks) {
+        if (!track.active) ranges.push_back({track.nominal_angle - SEARCH_WINDOW, track.nominal_angle + SEARCH_WINDOW});
+    }
+    LineHough hough(gray.size(), 1, CV_PI / 180, ranges);
+    std::vector<cv::Vec2f> lines;
+    hough.detect(edges, lines, hough_threshold);
+
+    // The most voted line of every window, as in the still image mode
+    for (Track& track : tracks) {
+        if (track.active) continue;
+        for (const cv::Vec2f& line : lines) {
+            if (std::abs(line[1] - track.nominal_angle) < SEARCH_WINDOW) {
+                startTrack(track, line);
+                break;
+            }
+        }
+    }
+}
+
+void LaneTracker::bandEdgePoints(const cv::Mat& gray, float rho, float theta, std::vector<cv::Point>& points) {
+    points.clear();
+    const double a = std::cos(theta), b = std::sin(theta);
+
+    // The strips go along the axis the line crosses most steeply: x = (rho - y * b) / a for the rows
+    // (|a| >= |b|), y = (rho - x * a) / b for the columns. "along" is the axis of the strips.
+    const bool by_rows = std::abs(a) >= std::abs(b);
+    const int along_size = by_rows ? gray.rows : gray.cols;
+    const int across_size = by_rows ? gray.cols : gray.rows;
+    const double divisor = by_rows ? a : b, along_factor = by_rows ? b : a;
+    const double half_extent = BAND_HALF_WIDTH / std::abs(divisor); // band half width measured across
+
+    for (int start = 0; start < along_size; start += STRIP_SIZE) {
+        int end = std::min(start + STRIP_SIZE, along_size);
+        double across0 = (rho - start * along_factor) / divisor;
+        double across1 = (rho - (end - 1) * along_factor) / divisor;
+        int from = std::max(0, cvFloor(std::min(across0, across1) - half_extent));
+        int to = std::min(across_size, cvCeil(std::max(across0, across1) + half_extent) + 1);
+        if (from >= to) continue; // the band is outside the image in this strip
+
+        int along_from = std::max(0, start - STRIP_MARGIN), along_to = std::min(along_size, end + STRIP_MARGIN);
+        int across_from = std::max(0, from - STRIP_MARGIN), across_to = std::min(across_size, to + STRIP_MARGIN);
+        cv::Rect window = by_rows ? cv::Rect(across_from, along_from, across_to - across_from, along_to - along_from)
+                                  : cv::Rect(along_from, across_from, along_to - along_from, across_to - across_from);
+        cv::Mat edges;
+        cv::Canny(gray(window), edges, CANNY_LOW, CANNY_HIGH, 3);
+
+        for (int y = 0; y < edges.rows; y++) {
+            const uchar* e = edges.ptr<uchar>(y);
+            for (int x = 0; x < edges.cols; x++) {
+                if (!e[x]) continue;
+                cv::Point p(window.x + x, window.y + y);
+                int along = by_rows ? p.y : p.x, across = by_rows ? p.x : p.y;
+                if (along < start || along >= end || across < from || across >= to) continue; // margin of the strip
+                if (std::abs(p.x * a + p.y * b - rho) <= BAND_HALF_WIDTH) points.push_back(p);
+            }
+        }
+    }
+}
+
+void LaneTracker::trackLine(const cv::Mat& gray, Track& track) {
+    const cv::Mat& prediction = track.filter.predict();
+    float rho = prediction.at<float>(0), theta = prediction.at<float>(1);
+
+    // Edges only in the band, Hough only in the theta window (the transform of the track is reused)
+    std::vector<cv::Point> points;
+    bandEdgePoints(gray, rho, theta, points);
+    if (!track.hough || track.hough->size() != gray.size()) {
+        track.hough.reset(new LineHough(gray.size(), 1, CV_PI / 180));
+    }
+    track.hough->setRanges({{theta - TRACK_WINDOW, theta + TRACK_WINDOW}});
+
+    cv::Vec2f measured;
+    bool found = false;
+    std::vector<cv::Vec2f> lines;
+    track.hough->detectPoints(points, lines, hough_threshold);
+    if (!lines.empty()) {
+        measured = lines[0];
+        found = true;
+    }
+
+    if (found) {
+        cv::Mat measurement(2, 1, CV_32F);
+        measurement.at<float>(0) = measured[0];
+        measurement.at<float>(1) = measured[1];
+        track.filter.correct(measurement);
+        track.missed_frames = 0;
+    } else {
+        // predict() already left the prediction as the state, it is used until the line is declared lost
+        if (++track.missed_frames > MAX_MISSED_FRAMES) track.active = false;
+    }
+}
+
+void LaneTracker::startTrack(Track& track, const cv::Vec2f& line) {
+    cv::KalmanFilter& filter = track.filter;
+    filter.init(4, 2, 0, CV_32F);
+    // rho += d_rho, theta += d_theta at every frame
+    cv::setIdentity(filter.transitionMatrix);
+    filter.transitionMatrix.at<float>(0, 2) = filter.transitionMatrix.at<float>(1, 3) = 1;
+    cv::setIdentity(filter.measurementMatrix);
+
+    // rho is in pixels and theta in radians, so the noise has a different scale for each
+    cv::setIdentity(filter.processNoiseCov, cv::Scalar(1e-2));
+    filter.processNoiseCov.at<float>(1, 1) = filter.processNoiseCov.at<float>(3, 3) = 1e-6f;
+    cv::setIdentity(filter.measurementNoiseCov, cv::Scalar(4));
+    filter.measurementNoiseCov.at<float>(1, 1) = 1e-4f;
+    cv::setIdentity(filter.errorCovPost, cv::Scalar(1));
+
+    filter.statePost = cv::Mat::zeros(4, 1, CV_32F);
+    filter.statePost.at<float>(0) = line[0];
+    filter.statePost.at<float>(1) = line[1];
+    track.active = true;
+    track.missed_frames = 0;
+}
+
+cv::Vec2f LaneTracker::state(const Track& track) {
+    return cv::Vec2f(track.filter.statePost.at<float>(0), track.filter.statePost.at<float>(1));
+}
@@ -0,0 +1,46 @@
+#ifndef LaneTracker_h
+#define LaneTracker_h
+#include <opencv2/opencv.hpp>
+#include <opencv2/video/tracking.hpp>
+#include <vector>
+#include <memory>
+#include "LineHough.h"
+
+/*
+Follows the two lane lines of the still image task along a video.
+Every line (rho, theta) has a constant-velocity Kalman filter. While it is tracked, Canny and the
+Hough voting only run in a narrow band around the predicted line and in a small theta window around
+the predicted angle; the whole frame is searched again only when a line has not been found for a
+few frames in a row. The band is covered by strips of a few rows (columns for lines closer to
+horizontal), each one only as wide as the band inside it, and every track keeps its transform and
+only moves its theta window.
+*/
+class LaneTracker {
+    public:
+    // angles in degrees, like the fixed angles of the still image mode
+    LaneTracker(double angle1_deg, double angle2_deg, int hough_threshold = 100);
+
+    // Returns false if the lines are not both known yet; full_search tells which kind of frame it was
+    bool process(const cv::Mat& frame, cv::Vec2f& line1, cv::Vec2f& line2, bool& full_search);
+
+    private:
+    struct Track {
+        double nominal_angle;     // radians, the angle searched when the line is lost
+        cv::KalmanFilter filter;  // state (rho, theta, d_rho, d_theta), measurement (rho, theta)
+        bool active = false;
+        int missed_frames = 0;
+        std::unique_ptr<LineHough> hough; // reused at every tracked frame
+    };
+
+    void fullSearch(const cv::Mat& gray);
+    void trackLine(const cv::Mat& gray, Track& track);
+    // Canny edge points at most BAND_HALF_WIDTH pixels away from the line
+    static void bandEdgePoints(const cv::Mat& gray, float rho, float theta, std::vector<cv::Point>& points);
+    static void startTrack(Track& track, const cv::Vec2f& line);
+    static cv::Vec2f state(const Track& track);
+
+    std::vector<Track> tracks;
+    int hough_threshold;
+};
+
+#endif
@@ -0,0 +1,162 @@
+#include "LineHough.h"
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <cmath>
+
+LineHough::LineHough(cv::Size image_size, double rho_step, double theta_step,
+                     const std::vector<ThetaRange>& ranges, const std::vector<cv::Point>& roi)
+    : image_size(image_size), rho_step(rho_step), theta_step(theta_step) {
+    CV_Assert(rho_step > 0 && theta_step > 0);
+
+    // Same grid of cv::HoughLines with min_theta = 0 and max_theta = pi
+    num_angles = cvFloor(CV_PI / theta_step) + 1;
+    if (num_angles > 1 && std::fabs(CV_PI - (num_angles - 1) * theta_step) < theta_step / 2) num_angles--;
+    num_rho = cvRound(((image_size.width + image_size.height) * 2 + 1) / rho_step);
+
+    setRanges(ranges);
+
+    if (!roi.empty()) {
+        roi_mask = cv::Mat::zeros(image_size, CV_8UC1);
+        std::vector<std::vector<cv::Point>> polygons = {roi};
+        cv::fillPoly(roi_mask, polygons, cv::Scalar(255));
+    }
+}
+
+void LineHough::setRanges(const std::vector<ThetaRange>& ranges) {
+    bins.clear();
+    reported.clear();
+    cos_table.clear();
+    sin_table.clear();
+
+    // Bins inside the ranges, then their neighbours so that the peak test sees the same values
+    std::vector<uchar> inside(num_angles, ranges.empty() ? 1 : 0);
+    for (const ThetaRange& range : ranges) {
+        for (int n = 0; n < num_angles; n++) {
+            double angle = n * theta_step;
+            if (angle >= range.from && angle <= range.to) inside[n] = 1;
+        }
+    }
+    // The angles are accumulated in float and the tables rounded to float, as cv::HoughLines does
+    const float inverse_rho = (float)(1.0 / rho_step);
+    float angle = 0;
+    for (int n = 0; n < num_angles; n++, angle += (float)theta_step) {
+        bool guard = (n > 0 && inside[n - 1]) || (n < num_angles - 1 && inside[n + 1]);
+        if (!inside[n] && !guard) continue;
+        bins.push_back(n);
+        reported.push_back(inside[n]);
+        cos_table.push_back((float)(std::cos((double)angle) * inverse_rho));
+        sin_table.push_back((float)(std::sin((double)angle) * inverse_rho));
+    }
+}
+
+void LineHough::edgePoints(const cv::Mat& edges, std::vector<cv::Point>& points) const {
+    CV_Assert(edges.type() == CV_8UC1 && edges.size() == image_size);
+    points.clear();
+    for (int y = 0; y < edges.rows; y++) {
+        const uchar* e = edges.ptr<uchar>(y);
+        const uchar* m = roi_mask.empty() ? nullptr : roi_mask.ptr<uchar>(y);
+        for (int x = 0; x < edges.cols; x++) {
+            if (e[x] && (!m || m[x])) points.push_back(cv::Point(x, y));
+        }
+    }
+}
+
+void LineHough::vote(const cv::Point* points, size_t count, cv::Mat& accumulator) const {
+    const int rows = (int)bins.size();
+    const int rho_offset = (num_rho - 1) / 2;
+    for (size_t i = 0; i < count; i++) {
+        const cv::Point& p = points[i];
+        for (int k = 0; k < rows; k++) {
+            int r = cvRound(p.x * cos_table[k] + p.y * sin_table[k]) + rho_offset;
+            accumulator.ptr<int>(k)[r + 1]++;
+        }
+    }
+}
+
+void LineHough::accumulate(const std::vector<cv::Point>& points, int threads, cv::Mat& accumulator) const {
+    const int rows = (int)bins.size(), stride = num_rho + 2;
+    accumulator = cv::Mat::zeros(rows, stride, CV_32SC1);
+
+    if (threads <= 0) threads = cv::getNumThreads();
+    threads = std::max(1, std::min<int>(threads, (int)points.size()));
+    if (threads == 1) {
+        vote(points.data(), points.size(), accumulator);
+        return;
+    }
+
+    // Every thread votes its slice of the points in a private accumulator (cv::Mat data is
+    // 64-byte aligned, so two threads never write on the same cache line)
+    std::vector<cv::Mat> partial(threads);
+    cv::parallel_for_(cv::Range(0, threads), [&](const cv::Range& range) {
+        for (int t = range.start; t < range.end; t++) {
+            size_t first = points.size() * t / threads, last = points.size() * (t + 1) / threads;
+            partial[t] = cv::Mat::zeros(rows, stride, CV_32SC1);
+            vote(points.data() + first, last - first, partial[t]);
+        }
+    }, threads);
+
+    // Sum them row by row, also in parallel, with the universal intrinsics (the lab builds do not
+    // optimise, so a plain loop would not be vectorised by the compiler)
+    cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range& range) {
+        for (int k = range.start; k < range.end; k++) {
+            int* total = accumulator.ptr<int>(k);
+            for (const cv::Mat& acc : partial) {
+                const int* votes = acc.ptr<int>(k);
+                int r = 0;
+#if CV_SIMD
+                const int lanes = cv::v_int32::nlanes;
+                for (; r <= stride - lanes; r += lanes) {
+                    cv::v_store(total + r, cv::vx_load(total + r) + cv::vx_load(votes + r));
+                }
+#endif
+                for (; r < stride; r++) total[r] += votes[r];
+            }
+        }
+    });
+}
+
+void LineHough::detect(const cv::Mat& edges, std::vector<cv::Vec2f>& lines, int threshold, int threads) const {
+    std::vector<cv::Point> points;
+    edgePoints(edges, points);
+    detectPoints(points, lines, threshold, threads);
+}
+
+void LineHough::detectPoints(const std::vector<cv::Point>& points, std::vector<cv::Vec2f>& lines, int threshold, int threads) const {
+    lines.clear();
+
+    // One row per voted bin, with one empty cell on each side of the rho axis
+    cv::Mat accumulator;
+    accumulate(points, threads, accumulator);
+    const int rows = accumulator.rows;
+
+    // Local maxima with the comparisons of cv::HoughLines; a neighbour bin that is not in
+    // the accumulator is outside [0, pi) and counts as 0, like the padding of the full one
+    struct Peak { int votes, bin, r; };
+    std::vector<Peak> peaks;
+    for (int k = 0; k < rows; k++) {
+        if (!reported[k]) continue;
+        const int* current = accumulator.ptr<int>(k);
+        const int* previous = (k > 0 && bins[k - 1] == bins[k] - 1) ? accumulator.ptr<int>(k - 1) : nullptr;
+        const int* next = (k < rows - 1 && bins[k + 1] == bins[k] + 1) ? accumulator.ptr<int>(k + 1) : nullptr;
+
+        for (int r = 1; r <= num_rho; r++) {
+            int votes = current[r];
+            if (votes > threshold && votes > current[r - 1] && votes >= current[r + 1] &&
+                votes > (previous ? previous[r] : 0) && votes >= (next ? next[r] : 0)) {
+                peaks.push_back({votes, bins[k], r - 1});
+            }
+        }
+    }
+
+    // Most voted first, ties in accumulator order
+    std::sort(peaks.begin(), peaks.end(), [](const Peak& a, const Peak& b) {
+        if (a.votes != b.votes) return a.votes > b.votes;
+        return a.bin != b.bin ? a.bin < b.bin : a.r < b.r;
+    });
+
+    for (const Peak& peak : peaks) {
+        float rho = (peak.r - (num_rho - 1) * 0.5f) * (float)rho_step;
+        float theta = peak.bin * (float)theta_step;
+        lines.push_back(cv::Vec2f(rho, theta));
+    }
+}
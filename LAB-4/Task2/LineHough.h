@@ -0,0 +1,60 @@
+#ifndef LineHough_h
+#define LineHough_h
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Closed interval of line angles, in radians (same convention of the theta of cv::HoughLines)
+struct ThetaRange {
+    double from;
+    double to;
+};
+
+/*
+Standard Hough transform for lines that only votes where we are going to look.
+It uses the same (rho, theta) grid, rounding and peak test of cv::HoughLines, but the accumulator
+only has the theta bins inside the given ranges (plus one bin on each side, used only by the peak
+test), and only the edge pixels inside the polygon ROI vote. The sin/cos of the bins are computed
+once per set of ranges (setRanges), and the edge pixels are collected in a list before voting.
+With no ranges and no ROI the lines are exactly the ones of cv::HoughLines.
+The voting can be split between threads: each one votes a slice of the edge point list in its
+own accumulator, then the accumulators are summed; the integer sums do not depend on the
+order, so the lines are the same for any number of threads.
+*/
+class LineHough {
+    public:
+    LineHough(cv::Size image_size, double rho_step, double theta_step,
+              const std::vector<ThetaRange>& ranges = {}, const std::vector<cv::Point>& roi = {});
+
+    // lines are (rho, theta), sorted by votes like cv::HoughLines; only bins with more than threshold votes.
+    // threads is the number of slices of the voting (0 means cv::getNumThreads()); they run on the
+    // OpenCV pool, so at most cv::getNumThreads() of them run at the same time
+    void detect(const cv::Mat& edges, std::vector<cv::Vec2f>& lines, int threshold, int threads = 0) const;
+    // Same, with edge points already collected by the caller (the ROI is not applied to them);
+    // the points must be inside the image
+    void detectPoints(const std::vector<cv::Point>& points, std::vector<cv::Vec2f>& lines, int threshold, int threads = 0) const;
+
+    // Moves the theta windows without building a new transform (the tables only cover the voted bins)
+    void setRanges(const std::vector<ThetaRange>& ranges);
+    cv::Size size() const { return image_size; }
+
+    // Number of theta bins of the accumulator, out of the ones of the full transform
+    int votedBins() const { return (int)bins.size(); }
+    int totalBins() const { return num_angles; }
+
+    private:
+    void edgePoints(const cv::Mat& edges, std::vector<cv::Point>& points) const;
+    // accumulator is CV_32SC1, one row per voted bin and num_rho + 2 columns
+    void vote(const cv::Point* points, size_t count, cv::Mat& accumulator) const;
+    void accumulate(const std::vector<cv::Point>& points, int threads, cv::Mat& accumulator) const;
+
+    cv::Size image_size;
+    double rho_step, theta_step;
+    int num_angles, num_rho;
+
+    std::vector<int> bins;        // global theta index of every accumulator row, increasing
+    std::vector<uchar> reported;  // 1 if the row is inside a range, 0 for the guard bins
+    std::vector<float> cos_table, sin_table; // already divided by rho_step
+    cv::Mat roi_mask;             // CV_8UC1, empty means the whole image
+};
+
+#endif
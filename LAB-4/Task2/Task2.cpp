@@ -1,11 +1,37 @@
 #include <opencv2/opencv.hpp>
 #include <iostream>
 #include <vector>
+#include <string>
 #include <cmath>
+#include <sstream>
+#include "LineHough.h"
+#include "LaneTracker.h"
+#include "RenderGraph.h"
+#include "PreviewLevel.h"
+#include "MaskWorker.h"
 
-int main() {
-    // Load image
-    cv::Mat src = cv::imread("street_scene.png");
+// Times the Hough voting with 1 to 32 threads and checks that the lines never change
+void benchHough(const cv::Mat& edges);
+// Tracks the two lines along a video (dashcam sequence), see LaneTracker
+int runSequence(const std::string& path, int angle1_deg, int angle2_deg);
+// Fills the triangle between the two lines and the bottom of the image
+void drawTriangle(cv::Mat& display, const cv::Vec2f& selLine1, const cv::Vec2f& selLine2);
+
+int main(int argc, char** argv) {
+    // Fixed angles: 139° and 40°
+    int angle1_deg = 139, angle2_deg = 40;
+
+    // Task2 [image] [--bench] or Task2 --video <file>
+    std::string filename = "street_scene.png";
+    bool bench = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--video" && i + 1 < argc) return runSequence(argv[i + 1], angle1_deg, angle2_deg); // sequence mode
+        if (arg == "--bench") bench = true;
+        else filename = arg;
+    }
+
+    cv::Mat src = cv::imread(filename);
     if (src.empty()) {
         std::cerr << "Error: Could not load image!" << std::endl;
         return -1;
@@ -15,18 +41,89 @@ int main() {
     cv::Mat gray, edges;
     cv::cvtColor(src, gray, cv::COLOR_BGR2GRAY);
     cv::Canny(gray, edges, 250, 250, 3);
-    cv::imshow("Canny Edge Detection", edges);
 
-    // Detect lines using HoughLines
-    std::vector<cv::Vec2f> lines;
-    cv::HoughLines(edges, lines, 1, CV_PI / 180, 100); 
+    // Task2 --bench: only measure the scaling of the Hough voting, no windows
+    if (bench) {
+        benchHough(edges);
+        return 0;
+    }
 
-    // Fixed angles: 139° and 40°
-    int angle1_deg = 139, angle2_deg = 40;
+    // Big images are shown on a pyramid level: an angle change is first computed there,
+    // and the full resolution lines are computed in the background when the user pauses
+    PreviewLevel preview(src.size());
+    cv::Mat preview_src, preview_edges;
+    preview.downscale(src, preview_src);
+    if (preview.active()) {
+        cv::Mat preview_gray;
+        preview.downscale(gray, preview_gray);
+        cv::Canny(preview_gray, preview_edges, 250, 250, 3);
+        std::cout << "Big image: previews at 1/" << (1 << preview.level()) << " resolution, refined when idle" << std::endl;
+    } else {
+        preview_edges = edges;
+    }
 
-    while (true) {
-        cv::Mat display = src.clone();
-        // Convert fixed angles from degrees to radians
+    // Every stage of the graph only runs again when something it reads has changed,
+    // so nothing is recomputed while idle
+    cv::imshow("Canny Edge Detection", preview_edges);
+
+    RenderGraph graph;
+    std::vector<cv::Vec2f> lines;    // in the coordinates of the window (the preview level)
+    Observable<int> refinements(0);  // grows when the full resolution lines replace the preview ones
+    MaskWorker::Job refine_job;      // full resolution job waiting for a pause
+    int64 preview_tick = 0;
+
+    // Detect lines with the Hough transform, voting only around the two angles we keep.
+    // An optional polygon (e.g. the road in front of the car) restricts the pixels that vote.
+    auto detectLines = [](const cv::Mat& level_edges, int a1_deg, int a2_deg, int threshold, std::vector<cv::Vec2f>& found,
+                          std::ostream& report) {
+        const double window = 5 * CV_PI / 180.0;
+        std::vector<ThetaRange> theta_ranges = {
+            {a1_deg * CV_PI / 180.0 - window, a1_deg * CV_PI / 180.0 + window},
+            {a2_deg * CV_PI / 180.0 - window, a2_deg * CV_PI / 180.0 + window}
+        };
+        std::vector<cv::Point> roi; // empty: the whole image
+        LineHough hough(level_edges.size(), 1, CV_PI / 180, theta_ranges, roi);
+
+        hough.detect(level_edges, found, threshold);
+        report << "Hough: " << hough.votedBins() << " of " << hough.totalBins() << " theta bins voted, "
+               << found.size() << " lines" << std::endl;
+    };
+
+    // Declared after everything it uses, so it is stopped before them
+    MaskWorker worker;
+
+    const Source& hough_stage = graph.addStage("hough", {}, [&]() {
+        if (!preview.active()) {
+            detectLines(edges, angle1_deg, angle2_deg, 100, lines, std::cout);
+            return;
+        }
+        // Preview now: the lines are 2^level times shorter, and so is the threshold
+        std::cout << "Preview (1/" << (1 << preview.level()) << " resolution) ";
+        detectLines(preview_edges, angle1_deg, angle2_deg, std::max(1, 100 >> preview.level()), lines, std::cout);
+
+        // Full resolution later, on the worker
+        const double to_preview = (double)preview.size().width / preview.fullSize().width;
+        preview_tick = cv::getTickCount();
+        refine_job = [&, to_preview](const MaskWorker::CancelCheck& cancelled) {
+            auto full_lines = std::make_shared<std::vector<cv::Vec2f>>();
+            std::ostringstream report;
+            detectLines(edges, angle1_deg, angle2_deg, 100, *full_lines, report);
+            if (cancelled()) return MaskWorker::Display();
+            for (cv::Vec2f& line : *full_lines) line[0] = (float)(line[0] * to_preview); // same theta, scaled rho
+
+            // This part runs on the GUI thread
+            std::string text = report.str();
+            return MaskWorker::Display([&, full_lines, text]() {
+                std::cout << "Full resolution " << text;
+                lines = *full_lines;
+                refinements.set(refinements.get() + 1);
+            });
+        };
+    });
+
+    graph.addStage("draw", {&hough_stage, &refinements}, [&]() {
+        cv::Mat display = preview_src.clone();
+        // Convert the selected angles from degrees to radians
         double a1_rad = angle1_deg * CV_PI / 180.0;
         double a2_rad = angle2_deg * CV_PI / 180.0;
         const double tolerance = 5 * CV_PI / 180.0; // 5 degree tolerance
@@ -47,7 +144,7 @@ int main() {
         bool found1 = false, found2 = false;
         cv::Vec2f selLine1, selLine2;
         for (const auto& line : lines) {
-            float rho = line[0], theta = line[1];
+            float theta = line[1];
             if (!found1 && std::abs(theta - a1_rad) < tolerance) {
                 selLine1 = line;
                 found1 = true;
@@ -61,42 +158,140 @@ int main() {
         }
 
         if (found1 && found2) {
-            // Compute intersections of each selected line with the bottom edge
-            int y_bottom = display.rows - 1;
-            double rho1 = selLine1[0], theta1 = selLine1[1];
-            double rho2 = selLine2[0], theta2 = selLine2[1];
-            cv::Point ptBottom1, ptBottom2;
-            if (std::abs(std::cos(theta1)) > 1e-6)
-                ptBottom1.x = cvRound((rho1 - y_bottom * std::sin(theta1)) / std::cos(theta1));
-            else
-                ptBottom1.x = 0;
-            ptBottom1.y = y_bottom;
-            if (std::abs(std::cos(theta2)) > 1e-6)
-                ptBottom2.x = cvRound((rho2 - y_bottom * std::sin(theta2)) / std::cos(theta2));
-            else
-                ptBottom2.x = 0;
-            ptBottom2.y = y_bottom;
-
-            // Compute the intersection of the two selected lines
-            double a1 = std::cos(theta1), b1 = std::sin(theta1), c1 = rho1;
-            double a2 = std::cos(theta2), b2 = std::sin(theta2), c2 = rho2;
-            double det = a1 * b2 - a2 * b1;
-            if (std::abs(det) > 1e-6) {
-                int x_inter = cvRound((c1 * b2 - c2 * b1) / det);
-                int y_inter = cvRound((a1 * c2 - a2 * c1) / det);
-                cv::Point ptIntersection(x_inter, y_inter);
-
-                // Create triangle from bottom intersections and line intersection
-                std::vector<cv::Point> triangle = {ptBottom1, ptBottom2, ptIntersection};
-                // Fill triangle with red color (BGR: 0,0,255)
-                cv::fillConvexPoly(display, triangle, cv::Scalar(0, 0, 255));
-                // Optionally, draw triangle outline
-                cv::polylines(display, triangle, true, cv::Scalar(0, 0, 255), 2);
-            }
+            drawTriangle(display, selLine1, selLine2);
         }
 
         cv::imshow("Selected Lines", display);
+    });
+
+    const double refine_delay_ms = 300; // pause after the preview before refining
+    while (true) {
+        graph.update();
         if (cv::waitKey(30) == 27) break; // exit if ESC is pressed
+        worker.poll();
+
+        double idle_ms = (cv::getTickCount() - preview_tick) * 1000.0 / cv::getTickFrequency();
+        if (refine_job && idle_ms >= refine_delay_ms) {
+            worker.submit(std::move(refine_job));
+            refine_job = nullptr;
+        }
     }
     return 0;
 }
+
+void benchHough(const cv::Mat& edges) {
+    // The full [0, pi) transform, so there is enough work to split
+    LineHough hough(edges.size(), 1, CV_PI / 180);
+    const int repetitions = 20;
+
+    // The edge points are collected once and serially, so the timings below are only the voting
+    // (and the peak search, which is also serial)
+    std::vector<cv::Point> points;
+    cv::TickMeter collect_timer;
+    collect_timer.start();
+    cv::findNonZero(edges, points);
+    collect_timer.stop();
+    std::cout << points.size() << " edge points, collected in " << collect_timer.getTimeMilli()
+              << " ms (serial, not included below)" << std::endl;
+
+    // parallel_for_ only uses as many workers as cv::getNumThreads(), so the pool is resized for every run
+    const int old_threads = cv::getNumThreads();
+    std::vector<cv::Vec2f> reference;
+    double serial_ms = 0;
+    for (int threads = 1; threads <= 32; threads *= 2) {
+        cv::setNumThreads(threads);
+        std::vector<cv::Vec2f> lines;
+        cv::TickMeter timer;
+        for (int i = 0; i < repetitions; i++) {
+            timer.start();
+            hough.detectPoints(points, lines, 100, threads);
+            timer.stop();
+        }
+        double ms = timer.getTimeMilli() / repetitions;
+        if (threads == 1) {
+            reference = lines;
+            serial_ms = ms;
+        }
+
+        bool same = lines.size() == reference.size();
+        for (size_t i = 0; same && i < lines.size(); i++) same = lines[i] == reference[i];
+        std::cout << threads << " threads: voting " << ms << " ms, speedup " << serial_ms / ms
+                  << ", " << lines.size() << " lines" << (same ? "" : " (DIFFERENT FROM 1 THREAD)") << std::endl;
+    }
+    cv::setNumThreads(old_threads);
+}
+
+void drawTriangle(cv::Mat& display, const cv::Vec2f& selLine1, const cv::Vec2f& selLine2) {
+    // Compute intersections of each selected line with the bottom edge
+    int y_bottom = display.rows - 1;
+    double rho1 = selLine1[0], theta1 = selLine1[1];
+    double rho2 = selLine2[0], theta2 = selLine2[1];
+    cv::Point ptBottom1, ptBottom2;
+    if (std::abs(std::cos(theta1)) > 1e-6)
+        ptBottom1.x = cvRound((rho1 - y_bottom * std::sin(theta1)) / std::cos(theta1));
+    else
+        ptBottom1.x = 0;
+    ptBottom1.y = y_bottom;
+    if (std::abs(std::cos(theta2)) > 1e-6)
+        ptBottom2.x = cvRound((rho2 - y_bottom * std::sin(theta2)) / std::cos(theta2));
+    else
+        ptBottom2.x = 0;
+    ptBottom2.y = y_bottom;
+
+    // Compute the intersection of the two selected lines
+    double a1 = std::cos(theta1), b1 = std::sin(theta1), c1 = rho1;
+    double a2 = std::cos(theta2), b2 = std::sin(theta2), c2 = rho2;
+    double det = a1 * b2 - a2 * b1;
+    if (std::abs(det) > 1e-6) {
+        int x_inter = cvRound((c1 * b2 - c2 * b1) / det);
+        int y_inter = cvRound((a1 * c2 - a2 * c1) / det);
+        cv::Point ptIntersection(x_inter, y_inter);
+
+        // Create triangle from bottom intersections and line intersection
+        std::vector<cv::Point> triangle = {ptBottom1, ptBottom2, ptIntersection};
+        // Fill triangle with red color (BGR: 0,0,255)
+        cv::fillConvexPoly(display, triangle, cv::Scalar(0, 0, 255));
+        // Optionally, draw triangle outline
+        cv::polylines(display, triangle, true, cv::Scalar(0, 0, 255), 2);
+    }
+}
+
+int runSequence(const std::string& path, int angle1_deg, int angle2_deg) {
+    cv::VideoCapture video(path);
+    if (!video.isOpened()) {
+        std::cerr << "Error: Could not open video " << path << std::endl;
+        return -1;
+    }
+
+    LaneTracker tracker(angle1_deg, angle2_deg);
+    cv::Mat frame;
+    double full_ms = 0, tracked_ms = 0;
+    int full_frames = 0, tracked_frames = 0;
+
+    while (video.read(frame)) {
+        cv::Vec2f line1, line2;
+        bool full_search;
+        cv::TickMeter timer;
+        timer.start();
+        bool found = tracker.process(frame, line1, line2, full_search);
+        timer.stop();
+        if (full_search) {
+            full_ms += timer.getTimeMilli();
+            full_frames++;
+        } else {
+            tracked_ms += timer.getTimeMilli();
+            tracked_frames++;
+        }
+
+        cv::Mat display = frame.clone();
+        if (found) drawTriangle(display, line1, line2);
+        std::string status = (full_search ? "search: " : "tracking: ") + std::to_string(timer.getTimeMilli()) + " ms";
+        cv::putText(display, status, cv::Point(10, 30), cv::FONT_HERSHEY_SIMPLEX, 0.8, cv::Scalar(0, 255, 0), 2);
+        cv::imshow("Selected Lines", display);
+        if (cv::waitKey(1) == 27) break; // exit if ESC is pressed
+    }
+
+    std::cout << "Full search: " << full_frames << " frames, " << (full_frames ? full_ms / full_frames : 0) << " ms per frame\n"
+              << "Tracking: " << tracked_frames << " frames, " << (tracked_frames ? tracked_ms / tracked_frames : 0) << " ms per frame" << std::endl;
+    return 0;
+}
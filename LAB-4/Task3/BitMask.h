@@ -0,0 +1,63 @@
+#ifndef BitMask_h
+#define BitMask_h
+#include <opencv2/opencv.hpp>
+
+/*
+Binary mask packed with one bit per pixel (8 pixels per byte, the leftmost pixel in the highest bit).
+The packed rows are stored in a CV_8UC1 cv::Mat, so the logical operations are done by the
+vectorised cv::bitwise_* functions and the area by the vectorised popcount of cv::hal::normHamming.
+The bits after the last column of every row are always kept to 0.
+*/
+class BitMask {
+    public:
+    BitMask() {}
+    BitMask(int rows, int cols);
+    explicit BitMask(const cv::Mat& mask);
+    // Copies own their bits (a cv::Mat copy would share them)
+    BitMask(const BitMask& other) : n_rows(other.n_rows), n_cols(other.n_cols), packed(other.packed.clone()) {}
+    BitMask& operator=(const BitMask& other);
+    BitMask(BitMask&&) = default;
+    BitMask& operator=(BitMask&&) = default;
+
+    // Every pixel with at least one non zero channel becomes 1
+    void fromMat(const cv::Mat& mask);
+    // Unpacks the mask into a CV_8UC1 image (0 / value)
+    void toMat(cv::Mat& output, uchar value = 255) const;
+
+    int rows() const { return n_rows; }
+    int cols() const { return n_cols; }
+    bool empty() const { return packed.empty(); }
+    const cv::Mat& bits() const { return packed; }
+    // Packed bytes of row y, for who wants to fill the mask 8 pixels at a time
+    uchar* ptr(int y) { return packed.ptr<uchar>(y); }
+    const uchar* ptr(int y) const { return packed.ptr<uchar>(y); }
+
+    bool get(int y, int x) const { return (packed.ptr<uchar>(y)[x >> 3] >> (7 - (x & 7))) & 1; }
+    void set(int y, int x, bool value = true);
+
+    BitMask& operator&=(const BitMask& other);
+    BitMask& operator|=(const BitMask& other);
+    BitMask& operator^=(const BitMask& other);
+    BitMask operator~() const;
+
+    // Number of pixels set to 1
+    int count() const;
+    // Smallest rectangle containing all the pixels set to 1 (empty if there are none)
+    cv::Rect boundingRect() const;
+
+    // Copies the pixels of src where the mask is 1 into dst (same as src.copyTo(dst, mask))
+    void copyMasked(const cv::Mat& src, cv::Mat& dst) const;
+
+    private:
+    void clearPadding();
+
+    int n_rows = 0;
+    int n_cols = 0;
+    cv::Mat packed; // CV_8UC1, (cols + 7) / 8 bytes per row
+};
+
+inline BitMask operator&(BitMask a, const BitMask& b) { return a &= b; }
+inline BitMask operator|(BitMask a, const BitMask& b) { return a |= b; }
+inline BitMask operator^(BitMask a, const BitMask& b) { return a ^= b; }
+
+#endif
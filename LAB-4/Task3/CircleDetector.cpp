@@ -0,0 +1,277 @@
+#include "CircleDetector.h"
+#include "Gradient.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const int MAX_BUCKETS = 8;
+const size_t MAX_CANDIDATES = 100; // most voted centres refined at full resolution
+
+struct EdgePoint {
+    cv::Point position;
+    float ux, uy; // unit gradient direction
+};
+
+// Canny on the image and the unit gradient of every edge pixel
+void edgePoints(const cv::Mat& gray, int canny_threshold, std::vector<EdgePoint>& points) {
+    // Derivatives and L2 magnitude in one pass, the magnitude is the norm of the unit vectors
+    Gradient gradient;
+    Gradient::compute(gray, gradient, 3, true);
+    cv::Mat edges;
+    cv::Canny(gradient.gx, gradient.gy, edges, canny_threshold / 2, canny_threshold);
+
+    points.clear();
+    for (int y = 0; y < edges.rows; y++) {
+        const uchar* e = edges.ptr<uchar>(y);
+        const short* gx = gradient.gx.ptr<short>(y);
+        const short* gy = gradient.gy.ptr<short>(y);
+        const int* magnitude = gradient.magnitude.ptr<int>(y);
+        for (int x = 0; x < edges.cols; x++) {
+            if (!e[x] || magnitude[x] == 0) continue;
+            float norm = (float)magnitude[x];
+            points.push_back({cv::Point(x, y), gx[x] / norm, gy[x] / norm});
+        }
+    }
+}
+
+struct Candidate {
+    int votes;
+    cv::Point center; // on the coarse level
+    int bucket;
+};
+
+// Full resolution search of one candidate
+struct Refinement {
+    double estimate_x, estimate_y;
+    int low, high;   // radius range
+    cv::Rect window; // around the estimate, inside the image
+    int region;      // index of the merged region that contains the window
+};
+
+// Overlapping windows are merged into their bounding box, so every pixel goes through Canny once
+void mergeWindows(std::vector<Refinement>& refinements, std::vector<cv::Rect>& regions) {
+    regions.clear();
+    for (const Refinement& refinement : refinements) {
+        cv::Rect merged = refinement.window;
+        for (size_t k = 0; k < regions.size();) {
+            if ((regions[k] & merged).area() > 0) {
+                merged |= regions[k];
+                regions.erase(regions.begin() + k);
+                k = 0; // the bigger box may touch the regions already checked
+            } else {
+                k++;
+            }
+        }
+        regions.push_back(merged);
+    }
+    for (Refinement& refinement : refinements) {
+        for (size_t k = 0; k < regions.size(); k++) {
+            if ((regions[k] & refinement.window) == refinement.window) {
+                refinement.region = (int)k;
+                break;
+            }
+        }
+    }
+}
+
+}
+
+void CircleDetector::detect(const cv::Mat& gray, std::vector<cv::Vec3f>& circles, const CircleParams& params) {
+    CV_Assert(gray.type() == CV_8UC1);
+    circles.clear();
+
+    int min_radius = std::max(1, params.min_radius);
+    int max_radius = params.max_radius > 0 ? params.max_radius : std::max(gray.rows, gray.cols) / 2;
+    if (max_radius < min_radius) return;
+
+    // With the automatic choice the smallest circle still has a radius of 3 pixels on the coarse level
+    int levels = params.levels;
+    if (levels < 0) {
+        levels = 0;
+        while (levels < 3 && (min_radius >> (levels + 1)) >= 3) levels++;
+    }
+    const int scale = 1 << levels;
+
+    cv::Mat coarse = gray;
+    for (int l = 0; l < levels; l++) cv::pyrDown(coarse, coarse);
+
+    // Coarse voting: a total accumulator for the centres and one per radius bucket
+    std::vector<EdgePoint> points;
+    edgePoints(coarse, params.canny_threshold, points);
+    const int r_min = std::max(1, min_radius / scale);
+    const int r_max = std::max(r_min, (max_radius + scale - 1) / scale);
+    const int bucket_width = (r_max - r_min) / MAX_BUCKETS + 1;
+    const int buckets = (r_max - r_min) / bucket_width + 1;
+
+    cv::Mat total = cv::Mat::zeros(coarse.size(), CV_32SC1);
+    std::vector<cv::Mat> bucket_votes(buckets);
+    for (cv::Mat& votes : bucket_votes) votes = cv::Mat::zeros(coarse.size(), CV_32SC1);
+
+    for (const EdgePoint& p : points) {
+        for (int sign = -1; sign <= 1; sign += 2) {
+            for (int r = r_min; r <= r_max; r++) {
+                int cx = cvRound(p.position.x + sign * r * p.ux);
+                int cy = cvRound(p.position.y + sign * r * p.uy);
+                if (cx < 0 || cy < 0 || cx >= coarse.cols || cy >= coarse.rows) break; // farther radii are outside too
+                total.at<int>(cy, cx)++;
+                bucket_votes[(r - r_min) / bucket_width].at<int>(cy, cx)++;
+            }
+        }
+    }
+
+    // Candidates: local maxima of the total; the circumference is 'scale' times shorter on this level,
+    // and the threshold is halved again because the refinement checks them at full resolution
+    const int coarse_threshold = std::max(1, params.votes_threshold / (2 * scale));
+    std::vector<Candidate> candidates;
+    for (int y = 1; y < total.rows - 1; y++) {
+        const int* above = total.ptr<int>(y - 1);
+        const int* row = total.ptr<int>(y);
+        const int* below = total.ptr<int>(y + 1);
+        for (int x = 1; x < total.cols - 1; x++) {
+            int v = row[x];
+            if (v <= coarse_threshold || v <= row[x - 1] || v < row[x + 1] || v <= above[x] || v < below[x]) continue;
+
+            // Bucket with most votes around the centre
+            int best_bucket = 0, best_votes = -1;
+            for (int b = 0; b < buckets; b++) {
+                int sum = 0;
+                for (int dy = -1; dy <= 1; dy++) {
+                    for (int dx = -1; dx <= 1; dx++) sum += bucket_votes[b].at<int>(y + dy, x + dx);
+                }
+                if (sum > best_votes) {
+                    best_votes = sum;
+                    best_bucket = b;
+                }
+            }
+            candidates.push_back({v, cv::Point(x, y), best_bucket});
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        if (a.votes != b.votes) return a.votes > b.votes;
+        return a.center.y != b.center.y ? a.center.y < b.center.y : a.center.x < b.center.x;
+    });
+
+    // Non-maximum suppression with min_dist already on the coarse level, and at most MAX_CANDIDATES
+    // of them, so the full resolution work stays bounded on textured images
+    std::vector<Candidate> selected;
+    const double coarse_min_dist = params.min_dist / scale;
+    for (const Candidate& candidate : candidates) {
+        if (selected.size() == MAX_CANDIDATES) break;
+        bool suppressed = false;
+        for (const Candidate& kept : selected) {
+            cv::Point d = candidate.center - kept.center;
+            if (d.x * d.x + d.y * d.y < coarse_min_dist * coarse_min_dist) {
+                suppressed = true;
+                break;
+            }
+        }
+        if (!suppressed) selected.push_back(candidate);
+    }
+
+    // Windows of the candidates at full resolution
+    const cv::Rect image(0, 0, gray.cols, gray.rows);
+    std::vector<Refinement> refinements;
+    for (const Candidate& candidate : selected) {
+        Refinement refinement;
+        refinement.estimate_x = (candidate.center.x + 0.5) * scale - 0.5;
+        refinement.estimate_y = (candidate.center.y + 0.5) * scale - 0.5;
+        refinement.low = std::max(min_radius, (r_min + candidate.bucket * bucket_width) * scale - scale);
+        refinement.high = std::min(max_radius, (r_min + (candidate.bucket + 1) * bucket_width - 1) * scale + scale);
+        if (refinement.high < refinement.low) continue;
+
+        int half = refinement.high + scale + 1;
+        refinement.window = cv::Rect(cvRound(refinement.estimate_x) - half, cvRound(refinement.estimate_y) - half,
+                                     2 * half + 1, 2 * half + 1) & image;
+        if (refinement.window.empty()) continue;
+        refinements.push_back(refinement);
+    }
+
+    // Edges at full resolution once, only over the union of the windows
+    std::vector<cv::Rect> regions;
+    mergeWindows(refinements, regions);
+    std::vector<std::vector<EdgePoint>> region_points(regions.size());
+    for (size_t k = 0; k < regions.size(); k++) edgePoints(gray(regions[k]), params.canny_threshold, region_points[k]);
+
+    // Refinement of every candidate with the edge pixels of its window
+    struct Refined {
+        cv::Vec3f circle;
+        int votes; // of the centre at full resolution
+    };
+    std::vector<Refined> refined;
+    std::vector<EdgePoint> window_points;
+    for (const Refinement& refinement : refinements) {
+        const double estimate_x = refinement.estimate_x, estimate_y = refinement.estimate_y;
+        const int low = refinement.low, high = refinement.high;
+        const cv::Rect& window = refinement.window;
+
+        // window coordinates from the ones of the region
+        const cv::Point offset = window.tl() - regions[refinement.region].tl();
+        window_points.clear();
+        for (const EdgePoint& p : region_points[refinement.region]) {
+            cv::Point position = p.position - offset;
+            if (position.x < 0 || position.y < 0 || position.x >= window.width || position.y >= window.height) continue;
+            window_points.push_back({position, p.ux, p.uy});
+        }
+
+        // Centre: votes only in the neighbourhood of the estimate (the coarse pixel and its neighbours)
+        const int reach = scale;
+        const int side = 2 * reach + 1;
+        std::vector<int> center_votes(side * side, 0);
+        const double origin_x = cvRound(estimate_x) - reach - window.x, origin_y = cvRound(estimate_y) - reach - window.y;
+        for (const EdgePoint& p : window_points) {
+            for (int sign = -1; sign <= 1; sign += 2) {
+                for (int r = low; r <= high; r++) {
+                    int cx = cvRound(p.position.x + sign * r * p.ux - origin_x);
+                    int cy = cvRound(p.position.y + sign * r * p.uy - origin_y);
+                    if (cx >= 0 && cy >= 0 && cx < side && cy < side) center_votes[cy * side + cx]++;
+                }
+            }
+        }
+        int best = (int)(std::max_element(center_votes.begin(), center_votes.end()) - center_votes.begin());
+        if (center_votes[best] < params.votes_threshold) continue; // the accumulator threshold of cv::HoughCircles
+        double center_x = origin_x + best % side, center_y = origin_y + best / side; // window coordinates
+
+        // Radius: histogram of the distances of the edge pixels whose gradient points to the centre
+        std::vector<int> histogram(high + 2, 0);
+        for (const EdgePoint& p : window_points) {
+            double vx = p.position.x - center_x, vy = p.position.y - center_y;
+            double distance = std::sqrt(vx * vx + vy * vy);
+            if (distance < low - 0.5 || distance > high + 0.5) continue;
+            if (std::abs(vx * p.ux + vy * p.uy) < 0.9 * distance) continue;
+            histogram[cvRound(distance)]++;
+        }
+        int best_radius = 0, support = 0;
+        for (int r = low; r <= high; r++) {
+            int votes = histogram[r - 1] + histogram[r] + histogram[r + 1];
+            if (votes > support) {
+                support = votes;
+                best_radius = r;
+            }
+        }
+        if (support < params.votes_threshold) continue;
+
+        // Sub-pixel radius from the three bins
+        double weighted = 0;
+        for (int r = best_radius - 1; r <= best_radius + 1; r++) weighted += (double)r * histogram[r];
+        double radius = weighted / support;
+        double x = center_x + window.x, y = center_y + window.y;
+        refined.push_back({cv::Vec3f((float)x, (float)y, (float)radius), center_votes[best]});
+    }
+
+    // Most voted first at full resolution (the coarse order breaks the ties), then min_dist again
+    // between the refined centres, like cv::HoughCircles
+    std::stable_sort(refined.begin(), refined.end(), [](const Refined& a, const Refined& b) { return a.votes > b.votes; });
+    for (const Refined& candidate : refined) {
+        const cv::Vec3f& circle = candidate.circle;
+        bool too_close = false;
+        for (const cv::Vec3f& c : circles) {
+            double dx = c[0] - circle[0], dy = c[1] - circle[1];
+            if (dx * dx + dy * dy < params.min_dist * params.min_dist) {
+                too_close = true;
+                break;
+            }
+        }
+        if (!too_close) circles.push_back(circle);
+    }
+}
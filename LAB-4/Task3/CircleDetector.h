@@ -0,0 +1,35 @@
+#ifndef CircleDetector_h
+#define CircleDetector_h
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Same meaning of the cv::HoughCircles parameters used by the trackbars
+struct CircleParams {
+    double min_dist = 1;      // minimum distance between the centres
+    int canny_threshold = 100; // high Canny threshold, the low one is half of it
+    int votes_threshold = 30;  // votes needed by the centre, and edge pixels needed on the circle
+    int min_radius = 0;
+    int max_radius = 0;        // 0 means up to half of the image size
+    int levels = -1;           // pyramid levels for the coarse search, -1 picks them from min_radius
+};
+
+/*
+Coarse-to-fine Hough circle detector.
+The centres are searched on a downscaled level of the pyramid: every edge pixel votes along its
+gradient direction (both ways) for all the radii of the range, and the votes are also kept in a
+few radius buckets, so every candidate centre comes with a rough radius. The candidates closer
+than min_dist to a more voted one are dropped already on that level, and at most the 100 most
+voted are kept. Then each candidate is refined at full resolution only in a window around it: the
+gradient and Canny run once over the union of the windows (overlapping windows are merged), the
+centre is voted again in a small neighbourhood and the radius is the most supported distance
+inside the bucket of the candidate. The refined circles are sorted by the votes of their centre at
+full resolution and min_dist is applied again between them.
+The full resolution work is bounded by the candidates, not by the image size.
+*/
+class CircleDetector {
+    public:
+    // gray is CV_8UC1 (already smoothed); circles are (x, y, radius) like cv::HoughCircles, most voted (at full resolution) first
+    static void detect(const cv::Mat& gray, std::vector<cv::Vec3f>& circles, const CircleParams& params);
+};
+
+#endif
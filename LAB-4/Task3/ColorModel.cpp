@@ -0,0 +1,66 @@
+#include "ColorModel.h"
+#include <algorithm>
+#include <cstring>
+
+// OpenCV 8 bit hue goes from 0 to 179
+static const int HUE_RANGE = 180;
+
+ColorModel::ColorModel() : lut((size_t)HUE_RANGE << 16, 0) {}
+
+void ColorModel::clear() {
+    boxes.clear();
+    std::fill(lut.begin(), lut.end(), 0);
+}
+
+void ColorModel::addClick(const cv::Vec3b& hsv, const HSVTolerance& tolerance) {
+    boxes.push_back({hsv, tolerance});
+
+    int s_min = std::max(0, hsv[1] - tolerance.s_tolerance), s_max = std::min(255, hsv[1] + tolerance.s_tolerance);
+    int v_min = std::max(0, hsv[2] - tolerance.v_tolerance), v_max = std::min(255, hsv[2] + tolerance.v_tolerance);
+    if (s_min > s_max || v_min > v_max) return;
+
+    // Hue is circular, the box can wrap around 0 (with a tolerance of 90 or more it covers all the hues)
+    int h_span = std::min(tolerance.h_tolerance, HUE_RANGE / 2);
+    for (int dh = -h_span; dh <= h_span; dh++) {
+        int h = ((hsv[0] + dh) % HUE_RANGE + HUE_RANGE) % HUE_RANGE;
+        for (int s = s_min; s <= s_max; s++) {
+            // the V values are contiguous in the table
+            std::memset(&lut[lutIndex(h, s, v_min)], 1, v_max - v_min + 1);
+        }
+    }
+}
+
+void ColorModel::update(const std::vector<Click>& clicks) {
+    bool same_prefix = clicks.size() >= boxes.size();
+    for (size_t k = 0; same_prefix && k < boxes.size(); k++) {
+        const Click& a = boxes[k];
+        const Click& b = clicks[k];
+        same_prefix = a.hsv == b.hsv &&
+                      a.tolerance.h_tolerance == b.tolerance.h_tolerance &&
+                      a.tolerance.s_tolerance == b.tolerance.s_tolerance &&
+                      a.tolerance.v_tolerance == b.tolerance.v_tolerance;
+    }
+    if (!same_prefix) clear();
+    for (size_t k = boxes.size(); k < clicks.size(); k++) {
+        addClick(clicks[k].hsv, clicks[k].tolerance);
+    }
+}
+
+int ColorModel::classify(const cv::Mat& hsv, BitMask& mask, const std::function<bool()>& cancelled) const {
+    CV_Assert(hsv.type() == CV_8UC3);
+    mask = BitMask(hsv.rows, hsv.cols);
+    const uchar* table = lut.data();
+    int area = 0;
+
+    for (int j = 0; j < hsv.rows; j++) {
+        if (cancelled && j % 64 == 0 && cancelled()) return -1;
+        const uchar* src = hsv.ptr<uchar>(j);
+        uchar* dst = mask.ptr(j);
+        for (int i = 0; i < hsv.cols; i++) {
+            uchar in = table[lutIndex(src[3 * i], src[3 * i + 1], src[3 * i + 2])];
+            dst[i >> 3] |= (uchar)(in << (7 - (i & 7)));
+            area += in;
+        }
+    }
+    return area;
+}
@@ -0,0 +1,47 @@
+#ifndef ColorModel_h
+#define ColorModel_h
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <functional>
+#include "ColorTolerance.h"
+#include "BitMask.h"
+
+/*
+Colour model made of several clicks: every click adds an HSV box (the clicked colour +- the tolerances).
+The union of the boxes is compiled into a lookup table over all the 180 x 256 x 256 HSV colours,
+so classifying a pixel costs one lookup no matter how many clicks contributed.
+Adding a click only writes the cells of its own box, so the table is updated incrementally.
+*/
+class ColorModel {
+    public:
+    // One click: the box is hsv +- tolerance
+    struct Click {
+        cv::Vec3b hsv;
+        HSVTolerance tolerance;
+    };
+
+    ColorModel();
+
+    // Forgets all the clicks
+    void clear();
+    // Adds the box around an HSV colour
+    void addClick(const cv::Vec3b& hsv, const HSVTolerance& tolerance);
+    // Makes the model match a list of clicks: if the list only adds clicks to the current ones,
+    // only the new boxes are written, otherwise the table is built again
+    void update(const std::vector<Click>& clicks);
+    int clicks() const { return (int)boxes.size(); }
+
+    bool contains(const cv::Vec3b& hsv) const { return lut[lutIndex(hsv[0], hsv[1], hsv[2])] != 0; }
+
+    // One lookup per pixel of the HSV image, the result is packed in the mask.
+    // Returns the number of matched pixels, or -1 if cancelled() became true.
+    int classify(const cv::Mat& hsv, BitMask& mask, const std::function<bool()>& cancelled = nullptr) const;
+
+    private:
+    static size_t lutIndex(int h, int s, int v) { return ((size_t)h << 16) | ((size_t)s << 8) | (size_t)v; }
+
+    std::vector<Click> boxes;
+    std::vector<uchar> lut; // 1 if the colour is inside at least one box
+};
+
+#endif
@@ -0,0 +1,169 @@
+#include "ConnectedComponents.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+// Union-find where the root is always the smallest label, so the roots come first in raster order
+int findRoot(std::vector<int>& parent, int label) {
+    while (parent[label] != label) {
+        parent[label] = parent[parent[label]]; // path halving
+        label = parent[label];
+    }
+    return label;
+}
+
+int merge(std::vector<int>& parent, int a, int b) {
+    int root_a = findRoot(parent, a);
+    int root_b = findRoot(parent, b);
+    if (root_a < root_b) {
+        parent[root_b] = root_a;
+        return root_a;
+    }
+    parent[root_a] = root_b;
+    return root_b;
+}
+
+// Statistics accumulated for every provisional label during the first scan
+struct PartialStats {
+    int area = 0;
+    int64 sum_x = 0, sum_y = 0;
+    int min_x = std::numeric_limits<int>::max(), min_y = std::numeric_limits<int>::max();
+    int max_x = -1, max_y = -1;
+
+    void add(int x, int y) {
+        area++;
+        sum_x += x;
+        sum_y += y;
+        min_x = std::min(min_x, x);
+        max_x = std::max(max_x, x);
+        min_y = std::min(min_y, y);
+        max_y = std::max(max_y, y);
+    }
+
+    void add(const PartialStats& other) {
+        area += other.area;
+        sum_x += other.sum_x;
+        sum_y += other.sum_y;
+        min_x = std::min(min_x, other.min_x);
+        max_x = std::max(max_x, other.max_x);
+        min_y = std::min(min_y, other.min_y);
+        max_y = std::max(max_y, other.max_y);
+    }
+};
+
+}
+
+int ConnectedComponents::label(const cv::Mat& mask, cv::Mat& labels, std::vector<ComponentStats>& stats, int bands) {
+    CV_Assert(mask.type() == CV_8UC1);
+    const int rows = mask.rows, cols = mask.cols;
+    labels = cv::Mat::zeros(rows, cols, CV_32SC1);
+    stats.clear();
+    if (rows == 0 || cols == 0) return 0;
+
+    if (bands <= 0) bands = cv::getNumThreads();
+    bands = std::max(1, std::min(bands, rows));
+
+    // With 8-connectivity a row can start at most (cols + 1) / 2 new labels, so every band
+    // gets its own range of provisional labels and the bands never write in the same place
+    const int labels_per_row = (cols + 1) / 2;
+    std::vector<int> band_start(bands + 1);
+    for (int b = 0; b <= bands; b++) band_start[b] = (int)((int64)rows * b / bands);
+
+    std::vector<int> parent((size_t)rows * labels_per_row + 1, 0);
+    std::vector<int> next_label(bands);                  // one after the last label used by every band
+    std::vector<std::vector<PartialStats>> partial(bands); // indexed by label - first label of the band
+
+    // First pass: provisional labels, local equivalences and statistics, band by band in parallel
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range) {
+        for (int b = range.start; b < range.end; b++) {
+            const int first_row = band_start[b], last_row = band_start[b + 1];
+            const int first_label = first_row * labels_per_row + 1;
+            int next = first_label;
+            std::vector<PartialStats>& band_stats = partial[b];
+
+            for (int y = first_row; y < last_row; y++) {
+                const uchar* src = mask.ptr<uchar>(y);
+                int* dst = labels.ptr<int>(y);
+                // the row above belongs to another band on the first row, those are merged later
+                const int* above = (y > first_row) ? labels.ptr<int>(y - 1) : nullptr;
+
+                for (int x = 0; x < cols; x++) {
+                    if (!src[x]) continue;
+
+                    // already scanned neighbours: left, up-left, up, up-right
+                    int neighbours[4] = {
+                        x > 0 ? dst[x - 1] : 0,
+                        above && x > 0 ? above[x - 1] : 0,
+                        above ? above[x] : 0,
+                        above && x < cols - 1 ? above[x + 1] : 0
+                    };
+
+                    int current = 0;
+                    for (int n : neighbours) {
+                        if (!n) continue;
+                        current = current ? merge(parent, current, n) : n;
+                    }
+                    if (!current) {
+                        current = next++;
+                        parent[current] = current;
+                        band_stats.emplace_back();
+                    }
+                    dst[x] = current;
+                    band_stats[current - first_label].add(x, y);
+                }
+            }
+            next_label[b] = next;
+        }
+    });
+
+    // Merge the labels that touch across the band boundaries (only one row per boundary)
+    for (int b = 1; b < bands; b++) {
+        const int y = band_start[b];
+        const int* row = labels.ptr<int>(y);
+        const int* above = labels.ptr<int>(y - 1);
+        for (int x = 0; x < cols; x++) {
+            if (!row[x]) continue;
+            for (int dx = -1; dx <= 1; dx++) {
+                if (x + dx >= 0 && x + dx < cols && above[x + dx]) merge(parent, row[x], above[x + dx]);
+            }
+        }
+    }
+
+    // Flatten: the roots get the final labels in raster order and collect the statistics of their tree.
+    // Every label has a smaller (or equal) root, so the roots are always numbered before their children.
+    std::vector<int> final_label(parent.size(), 0);
+    std::vector<PartialStats> merged;
+    for (int b = 0; b < bands; b++) {
+        const int first_label = band_start[b] * labels_per_row + 1;
+        for (int l = first_label; l < next_label[b]; l++) {
+            int root = findRoot(parent, l);
+            if (root == l) {
+                final_label[l] = (int)merged.size() + 1;
+                merged.emplace_back();
+            } else {
+                final_label[l] = final_label[root];
+            }
+            merged[final_label[l] - 1].add(partial[b][l - first_label]);
+        }
+    }
+
+    // Second pass: final labels, in parallel again
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range) {
+        for (int y = band_start[range.start]; y < band_start[range.end]; y++) {
+            int* dst = labels.ptr<int>(y);
+            for (int x = 0; x < cols; x++) {
+                dst[x] = final_label[dst[x]];
+            }
+        }
+    });
+
+    stats.resize(merged.size());
+    for (size_t i = 0; i < merged.size(); i++) {
+        const PartialStats& m = merged[i];
+        stats[i].area = m.area;
+        stats[i].bounding_box = cv::Rect(m.min_x, m.min_y, m.max_x - m.min_x + 1, m.max_y - m.min_y + 1);
+        stats[i].centroid = cv::Point2d((double)m.sum_x / m.area, (double)m.sum_y / m.area);
+    }
+    return (int)stats.size();
+}
@@ -0,0 +1,27 @@
+#ifndef ConnectedComponents_h
+#define ConnectedComponents_h
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Statistics of one blob of the mask
+struct ComponentStats {
+    int area = 0;
+    cv::Rect bounding_box;
+    cv::Point2d centroid;
+};
+
+/*
+Connected component labelling (8-connectivity) of a binary mask.
+The image is split in horizontal bands that are labelled in parallel with the classic two-pass
+algorithm and a union-find of the provisional labels; the statistics are accumulated during the
+first scan. Then the labels that touch across the band boundaries are merged and the second pass
+(again in parallel) writes the final labels.
+*/
+class ConnectedComponents {
+    public:
+    // labels becomes CV_32SC1 with 0 for the background and 1..n for the components, stats[i] is component i + 1.
+    // bands = 0 means one band per thread. Returns the number of components.
+    static int label(const cv::Mat& mask, cv::Mat& labels, std::vector<ComponentStats>& stats, int bands = 0);
+};
+
+#endif
@@ -0,0 +1,145 @@
+#include "Gradient.h"
+#include <opencv2/core/hal/intrin.hpp>
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+    const int CANNY_SHIFT = 15;
+    const int TG22 = (int)(0.4142135623730950488016887242097 * (1 << CANNY_SHIFT) + 0.5);
+
+    // One pixel, for the tail of the rows (and the builds without SIMD)
+    template <bool L2>
+    inline void magnitudeAndDirection(int xs, int ys, int& magnitude, uchar& orientation) {
+        int x = std::abs(xs), y = std::abs(ys);
+        // the float sqrt and the rounding of the vector path, so both give the same values
+        magnitude = L2 ? cvRound(std::sqrt((float)(xs * xs + ys * ys))) : x + y;
+
+        int tg22x = x * TG22;
+        int tg67x = tg22x + (x << (CANNY_SHIFT + 1));
+        int y_shifted = y << CANNY_SHIFT;
+        uchar diagonal = (xs ^ ys) < 0 ? Gradient::ANTI_DIAGONAL : Gradient::DIAGONAL;
+        orientation = y_shifted < tg22x ? (uchar)Gradient::HORIZONTAL : (y_shifted > tg67x ? (uchar)Gradient::VERTICAL : diagonal);
+    }
+
+#if CV_SIMD
+    // Same computations on int32 lanes; the sector is chosen with masks instead of branches
+    template <bool L2>
+    inline cv::v_int32 magnitudeLanes(const cv::v_int32& xs, const cv::v_int32& ys, const cv::v_int32& x, const cv::v_int32& y) {
+        if (L2) return cv::v_round(cv::v_sqrt(cv::v_cvt_f32(xs * xs + ys * ys)));
+        return x + y;
+    }
+
+    inline cv::v_int32 sectorLanes(const cv::v_int32& x, const cv::v_int32& y, const cv::v_int32& signs) {
+        cv::v_int32 tg22x = x * cv::vx_setall_s32(TG22);
+        cv::v_int32 tg67x = tg22x + cv::v_shl<CANNY_SHIFT + 1>(x);
+        cv::v_int32 y_shifted = cv::v_shl<CANNY_SHIFT>(y);
+        cv::v_int32 diagonal = cv::v_select(signs < cv::vx_setzero_s32(), cv::vx_setall_s32(Gradient::ANTI_DIAGONAL),
+                                            cv::vx_setall_s32(Gradient::DIAGONAL));
+        return cv::v_select(y_shifted < tg22x, cv::vx_setall_s32(Gradient::HORIZONTAL),
+                            cv::v_select(y_shifted > tg67x, cv::vx_setall_s32(Gradient::VERTICAL), diagonal));
+    }
+#endif
+
+    // Magnitude and sector of one row; the L1/L2 choice is a template parameter, so it is out of the loop
+    template <bool L2>
+    void magnitudeAndDirection(const short* gx, const short* gy, int* magnitude, uchar* orientation, int cols) {
+        int i = 0;
+#if CV_SIMD
+        const int lanes = cv::v_int16::nlanes, half = cv::v_int32::nlanes;
+        for (; i <= cols - lanes; i += lanes) {
+            cv::v_int16 xs16 = cv::vx_load(gx + i), ys16 = cv::vx_load(gy + i);
+            cv::v_int32 xs[2], ys[2], signs[2];
+            cv::v_expand(xs16, xs[0], xs[1]);
+            cv::v_expand(ys16, ys[0], ys[1]);
+            cv::v_expand(xs16 ^ ys16, signs[0], signs[1]);
+
+            cv::v_int32 sectors[2];
+            for (int h = 0; h < 2; h++) {
+                cv::v_int32 x = cv::v_reinterpret_as_s32(cv::v_abs(xs[h]));
+                cv::v_int32 y = cv::v_reinterpret_as_s32(cv::v_abs(ys[h]));
+                cv::v_store(magnitude + i + h * half, magnitudeLanes<L2>(xs[h], ys[h], x, y));
+                sectors[h] = sectorLanes(x, y, signs[h]);
+            }
+            cv::v_pack_u_store(orientation + i, cv::v_pack(sectors[0], sectors[1]));
+        }
+#endif
+        for (; i < cols; i++) {
+            magnitudeAndDirection<L2>(gx[i], gy[i], magnitude[i], orientation[i]);
+        }
+    }
+
+    void magnitudeAndDirection(const short* gx, const short* gy, int* magnitude, uchar* orientation, int cols, bool l2) {
+        if (l2) {
+            magnitudeAndDirection<true>(gx, gy, magnitude, orientation, cols);
+        } else {
+            magnitudeAndDirection<false>(gx, gy, magnitude, orientation, cols);
+        }
+    }
+}
+
+void Gradient::compute(const cv::Mat& gray, Gradient& gradient, int aperture_size, bool l2) {
+    CV_Assert(gray.type() == CV_8UC1);
+    gradient.l2 = l2;
+    gradient.magnitude.create(gray.rows, gray.cols, CV_32SC1);
+    gradient.orientation.create(gray.rows, gray.cols, CV_8UC1);
+
+    if (aperture_size == 3) {
+        fused3x3(gray, gradient);
+    } else {
+        // The 7x7 derivatives do not fit in 16 bits: scaled by 1/16 like cv::Canny does
+        double scale = aperture_size == 7 ? 1 / 16.0 : 1;
+        cv::Sobel(gray, gradient.gx, CV_16S, 1, 0, aperture_size, scale, 0, cv::BORDER_REPLICATE);
+        cv::Sobel(gray, gradient.gy, CV_16S, 0, 1, aperture_size, scale, 0, cv::BORDER_REPLICATE);
+        fromDerivatives(gradient);
+    }
+}
+
+void Gradient::fused3x3(const cv::Mat& gray, Gradient& gradient) {
+    const int rows = gray.rows, cols = gray.cols;
+    gradient.gx.create(rows, cols, CV_16SC1);
+    gradient.gy.create(rows, cols, CV_16SC1);
+
+    // One pixel of replicated border, so every row is read with the same contiguous loop
+    cv::Mat padded;
+    cv::copyMakeBorder(gray, padded, 1, 1, 1, 1, cv::BORDER_REPLICATE);
+
+    for (int j = 0; j < rows; j++) {
+        const uchar* above = padded.ptr<uchar>(j) + 1;
+        const uchar* center = padded.ptr<uchar>(j + 1) + 1;
+        const uchar* below = padded.ptr<uchar>(j + 2) + 1;
+        short* gx = gradient.gx.ptr<short>(j);
+        short* gy = gradient.gy.ptr<short>(j);
+
+        // [-1 0 1; -2 0 2; -1 0 1] and its transpose (at most 4 * 255 in absolute value, no saturation)
+        int i = 0;
+#if CV_SIMD
+        const int lanes = cv::v_int16::nlanes;
+        for (; i <= cols - lanes; i += lanes) {
+            cv::v_int16 above_left = cv::v_reinterpret_as_s16(cv::vx_load_expand(above + i - 1));
+            cv::v_int16 above_mid = cv::v_reinterpret_as_s16(cv::vx_load_expand(above + i));
+            cv::v_int16 above_right = cv::v_reinterpret_as_s16(cv::vx_load_expand(above + i + 1));
+            cv::v_int16 center_left = cv::v_reinterpret_as_s16(cv::vx_load_expand(center + i - 1));
+            cv::v_int16 center_right = cv::v_reinterpret_as_s16(cv::vx_load_expand(center + i + 1));
+            cv::v_int16 below_left = cv::v_reinterpret_as_s16(cv::vx_load_expand(below + i - 1));
+            cv::v_int16 below_mid = cv::v_reinterpret_as_s16(cv::vx_load_expand(below + i));
+            cv::v_int16 below_right = cv::v_reinterpret_as_s16(cv::vx_load_expand(below + i + 1));
+
+            cv::v_store(gx + i, (above_right - above_left) + cv::v_shl<1>(center_right - center_left) + (below_right - below_left));
+            cv::v_store(gy + i, (below_left - above_left) + cv::v_shl<1>(below_mid - above_mid) + (below_right - above_right));
+        }
+#endif
+        for (; i < cols; i++) {
+            gx[i] = (short)((above[i + 1] - above[i - 1]) + 2 * (center[i + 1] - center[i - 1]) + (below[i + 1] - below[i - 1]));
+            gy[i] = (short)((below[i - 1] - above[i - 1]) + 2 * (below[i] - above[i]) + (below[i + 1] - above[i + 1]));
+        }
+        // The row of derivatives is still in the cache
+        magnitudeAndDirection(gx, gy, gradient.magnitude.ptr<int>(j), gradient.orientation.ptr<uchar>(j), cols, gradient.l2);
+    }
+}
+
+void Gradient::fromDerivatives(Gradient& gradient) {
+    for (int j = 0; j < gradient.gx.rows; j++) {
+        magnitudeAndDirection(gradient.gx.ptr<short>(j), gradient.gy.ptr<short>(j),
+                              gradient.magnitude.ptr<int>(j), gradient.orientation.ptr<uchar>(j), gradient.gx.cols, gradient.l2);
+    }
+}
@@ -0,0 +1,94 @@
+#include "MaskWorker.h"
+#include <iostream>
+
+MaskWorker::MaskWorker() {
+    thread = std::thread(&MaskWorker::run, this);
+}
+
+MaskWorker::~MaskWorker() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+        generation++; // cancels the job in flight
+    }
+    wake_up.notify_one();
+    thread.join();
+}
+
+void MaskWorker::submit(Job job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        generation++;
+        if (pending_job) cancelled_jobs++; // a job still waiting is simply replaced
+        pending_job = std::move(job);
+        pending_tick = cv::getTickCount();
+    }
+    wake_up.notify_one();
+}
+
+void MaskWorker::run() {
+    while (true) {
+        Job job;
+        unsigned long my_generation;
+        int64 submit_tick;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake_up.wait(lock, [this] { return stop || pending_job; });
+            if (stop) return;
+            job = std::move(pending_job);
+            pending_job = nullptr;
+            running = true;
+            my_generation = generation;
+            submit_tick = pending_tick;
+        }
+
+        CancelCheck cancelled = [this, my_generation] { return generation != my_generation; };
+        int64 start = cv::getTickCount();
+        Display display = job(cancelled);
+        double compute_ms = (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+            if (!display || cancelled()) {
+                cancelled_jobs++;
+            } else {
+                ready_display = std::move(display);
+                ready_generation = my_generation;
+                ready_submit_tick = submit_tick;
+                ready_compute_ms = compute_ms;
+            }
+        }
+        idle.notify_all();
+    }
+}
+
+void MaskWorker::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return !pending_job && !running; });
+}
+
+bool MaskWorker::poll() {
+    Display display;
+    int64 submit_tick;
+    double compute_ms;
+    int cancelled;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // a result that arrived after a newer click is not worth showing anymore
+        if (!ready_display || ready_generation != generation) return false;
+        display = std::move(ready_display);
+        ready_display = nullptr;
+        submit_tick = ready_submit_tick;
+        compute_ms = ready_compute_ms;
+        cancelled = cancelled_jobs;
+        cancelled_jobs = 0;
+    }
+
+    display();
+    double latency_ms = (cv::getTickCount() - submit_tick) * 1000.0 / cv::getTickFrequency();
+    std::cout << "Click -> display: " << latency_ms << " ms (computation " << compute_ms << " ms";
+    if (cancelled > 0) std::cout << ", " << cancelled << " older clicks cancelled";
+    std::cout << ")" << std::endl;
+    return true;
+}
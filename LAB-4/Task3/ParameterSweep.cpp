@@ -0,0 +1,181 @@
+#include "ParameterSweep.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+bool ParameterSweep::loadGrid(const std::string& path, std::map<std::string, std::vector<double>>& grid) {
+    static const std::vector<std::string> names = {"blur", "canny", "dp", "minDist", "param1", "param2", "minRadius", "maxRadius"};
+    std::ifstream file(path);
+    if (!file) return false;
+
+    grid.clear();
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string name;
+        if (!(fields >> name) || name[0] == '#') continue;
+        if (std::find(names.begin(), names.end(), name) == names.end()) {
+            std::cerr << "Unknown parameter '" << name << "' in " << path << std::endl;
+            return false;
+        }
+        std::vector<double>& values = grid[name];
+        double value;
+        while (fields >> value) values.push_back(value);
+        if (values.empty()) return false;
+    }
+    return true;
+}
+
+bool ParameterSweep::loadGroundTruth(const std::string& path, std::vector<cv::Vec3f>& circles) {
+    std::ifstream file(path);
+    if (!file) return false;
+
+    circles.clear();
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') continue;
+        std::istringstream fields(line);
+        float x, y, r;
+        if (!(fields >> x >> y >> r)) return false;
+        circles.push_back(cv::Vec3f(x, y, r));
+    }
+    return true;
+}
+
+std::vector<SweepSetting> ParameterSweep::settings(const std::map<std::string, std::vector<double>>& grid, const cv::Size& image_size) {
+    SweepSetting base;
+    base.min_dist = image_size.height / 8; // the initial trackbar value of Task3
+
+    // Cartesian product, one parameter at a time
+    std::vector<SweepSetting> all = {base};
+    for (const auto& entry : grid) {
+        const std::string& name = entry.first;
+        std::vector<SweepSetting> expanded;
+        for (const SweepSetting& setting : all) {
+            for (double value : entry.second) {
+                SweepSetting s = setting;
+                if (name == "blur") s.blur = (int)value | 1; // GaussianBlur wants an odd size
+                else if (name == "canny") s.canny = (int)value;
+                else if (name == "dp") s.dp = value;
+                else if (name == "minDist") s.min_dist = value;
+                else if (name == "param1") s.param1 = value;
+                else if (name == "param2") s.param2 = value;
+                else if (name == "minRadius") s.min_radius = (int)value;
+                else if (name == "maxRadius") s.max_radius = (int)value;
+                expanded.push_back(s);
+            }
+        }
+        all.swap(expanded);
+    }
+    return all;
+}
+
+int ParameterSweep::matches(const std::vector<cv::Vec3f>& detected, const std::vector<cv::Vec3f>& ground_truth) {
+    std::vector<bool> used(ground_truth.size(), false);
+    int found = 0;
+    for (const cv::Vec3f& d : detected) {
+        int best = -1;
+        double best_distance = 0;
+        for (size_t i = 0; i < ground_truth.size(); i++) {
+            if (used[i]) continue;
+            const cv::Vec3f& g = ground_truth[i];
+            double distance = std::hypot(d[0] - g[0], d[1] - g[1]);
+            if (distance > std::max(3.0, 0.5 * g[2]) || std::abs(d[2] - g[2]) > 0.3 * g[2]) continue;
+            if (best < 0 || distance < best_distance) {
+                best = (int)i;
+                best_distance = distance;
+            }
+        }
+        if (best >= 0) {
+            used[best] = true;
+            found++;
+        }
+    }
+    return found;
+}
+
+std::vector<SweepResult> ParameterSweep::run(const cv::Mat& bgr, const std::vector<SweepSetting>& settings, const std::vector<cv::Vec3f>& ground_truth) {
+    // Shared stages, computed in parallel before the sweep: one gray image per blur size,
+    // then one edge image per (blur, canny) pair from the gray image of its blur
+    std::vector<int> blurs;
+    std::vector<std::pair<int, int>> keys;
+    for (const SweepSetting& s : settings) {
+        blurs.push_back(s.blur);
+        keys.push_back({s.blur, s.canny});
+    }
+    std::sort(blurs.begin(), blurs.end());
+    blurs.erase(std::unique(blurs.begin(), blurs.end()), blurs.end());
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    std::vector<cv::Mat> grays(blurs.size());
+    cv::parallel_for_(cv::Range(0, (int)blurs.size()), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; i++) {
+            cv::Mat blurred;
+            cv::GaussianBlur(bgr, blurred, cv::Size(blurs[i], blurs[i]), 1.5);
+            cv::cvtColor(blurred, grays[i], cv::COLOR_BGR2GRAY);
+        }
+    });
+
+    std::vector<cv::Mat> edges(keys.size());
+    cv::parallel_for_(cv::Range(0, (int)keys.size()), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; i++) {
+            size_t blur = std::lower_bound(blurs.begin(), blurs.end(), keys[i].first) - blurs.begin();
+            cv::Canny(grays[blur], edges[i], keys[i].second, keys[i].second, 3);
+        }
+    });
+    std::cout << "Sweep: " << settings.size() << " settings sharing " << blurs.size() << " gray and "
+              << keys.size() << " edge images" << std::endl;
+
+    // Every setting only reads the shared images and writes its own result
+    std::vector<SweepResult> results(settings.size());
+    cv::parallel_for_(cv::Range(0, (int)settings.size()), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; i++) {
+            const SweepSetting& s = settings[i];
+            size_t key = std::lower_bound(keys.begin(), keys.end(), std::make_pair(s.blur, s.canny)) - keys.begin();
+
+            std::vector<cv::Vec3f> circles;
+            cv::TickMeter timer;
+            timer.start();
+            cv::HoughCircles(edges[key], circles, cv::HOUGH_GRADIENT, s.dp, s.min_dist, s.param1, s.param2, s.min_radius, s.max_radius);
+            timer.stop();
+
+            SweepResult& r = results[i];
+            r.setting = s;
+            r.ms = timer.getTimeMilli();
+            r.detected = (int)circles.size();
+            r.true_positives = matches(circles, ground_truth);
+            r.precision = r.detected ? (double)r.true_positives / r.detected : 0;
+            r.recall = ground_truth.empty() ? 0 : (double)r.true_positives / ground_truth.size();
+            r.f1 = (r.precision + r.recall > 0) ? 2 * r.precision * r.recall / (r.precision + r.recall) : 0;
+        }
+    });
+
+    // Best F1 first, then the most precise; the results are still in the order of the grid and the sort
+    // is stable, so that order breaks the ties. The time is not a key: it changes from run to run, and
+    // so would the ranking.
+    std::stable_sort(results.begin(), results.end(), [](const SweepResult& a, const SweepResult& b) {
+        if (a.f1 != b.f1) return a.f1 > b.f1;
+        return a.precision > b.precision;
+    });
+    return results;
+}
+
+bool ParameterSweep::writeCsv(const std::string& path, const std::vector<SweepResult>& results) {
+    std::ofstream file(path);
+    if (!file) return false;
+
+    file << "rank,blur,canny,dp,minDist,param1,param2,minRadius,maxRadius,detected,true_positives,precision,recall,f1,ms\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const SweepResult& r = results[i];
+        const SweepSetting& s = r.setting;
+        file << i + 1 << "," << s.blur << "," << s.canny << "," << s.dp << "," << s.min_dist << ","
+             << s.param1 << "," << s.param2 << "," << s.min_radius << "," << s.max_radius << ","
+             << r.detected << "," << r.true_positives << "," << r.precision << "," << r.recall << ","
+             << r.f1 << "," << r.ms << "\n";
+    }
+    return (bool)file;
+}
@@ -0,0 +1,56 @@
+#ifndef ParameterSweep_h
+#define ParameterSweep_h
+#include <opencv2/opencv.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+// One combination of the parameters of Task3 (pre-processing + cv::HoughCircles)
+struct SweepSetting {
+    int blur = 5;           // Gaussian kernel size (sigma 1.5, like Task3)
+    int canny = 250;        // thresholds of the Canny before HoughCircles (low = high, like Task3)
+    double dp = 1.5;
+    double min_dist = 20;
+    double param1 = 150;
+    double param2 = 26;
+    int min_radius = 7;
+    int max_radius = 15;
+};
+
+struct SweepResult {
+    SweepSetting setting;
+    int detected = 0;
+    int true_positives = 0;
+    double precision = 0, recall = 0, f1 = 0;
+    double ms = 0; // time of HoughCircles only
+};
+
+/*
+Headless tuning of the circle detection of Task3.
+The grid file has one parameter per line followed by its values, e.g. "param2 20 26 30" (names:
+blur, canny, dp, minDist, param1, param2, minRadius, maxRadius; a missing parameter keeps the value
+of Task3). Every combination is run against the ground truth circles ("x y radius" per line, see
+street_scene_truth.txt). The gray image only depends on blur and the edges on (blur, canny), so they
+are computed once per blur and once per pair and shared by all the settings; the settings themselves
+are evaluated in parallel. The ranking does not depend on the timings, so it is the same at every run.
+*/
+class ParameterSweep {
+    public:
+    // Returns false if a file cannot be read or has a wrong line
+    static bool loadGrid(const std::string& path, std::map<std::string, std::vector<double>>& grid);
+    static bool loadGroundTruth(const std::string& path, std::vector<cv::Vec3f>& circles);
+
+    // All the combinations of the grid, with the Task3 values for the missing parameters
+    static std::vector<SweepSetting> settings(const std::map<std::string, std::vector<double>>& grid, const cv::Size& image_size);
+
+    // Results sorted from the best F1 score, then precision, then the order of the grid
+    static std::vector<SweepResult> run(const cv::Mat& bgr, const std::vector<SweepSetting>& settings, const std::vector<cv::Vec3f>& ground_truth);
+
+    static bool writeCsv(const std::string& path, const std::vector<SweepResult>& results);
+
+    // A detection matches a ground truth circle (each one at most once) if the centres are closer
+    // than half the true radius (at least 3 pixels) and the radii differ by less than 30%
+    static int matches(const std::vector<cv::Vec3f>& detected, const std::vector<cv::Vec3f>& ground_truth);
+};
+
+#endif
@@ -0,0 +1,41 @@
+#include "RenderGraph.h"
+
+const Source& RenderGraph::addStage(const std::string& name, const std::vector<const Source*>& inputs, const std::function<void()>& run) {
+    auto stage = std::make_unique<Stage>();
+    stage->name = name;
+    stage->inputs = inputs;
+    stage->seen.assign(inputs.size(), 0);
+    stage->run = run;
+    stages.push_back(std::move(stage));
+    return *stages.back();
+}
+
+int RenderGraph::update() {
+    int ran = 0;
+    for (auto& stage : stages) {
+        bool changed = !stage->has_run;
+        for (size_t i = 0; i < stage->inputs.size(); i++) {
+            if (stage->inputs[i]->version() != stage->seen[i]) changed = true;
+        }
+        if (!changed) continue;
+
+        // The versions are read before running, so a change made during the run is seen next time
+        for (size_t i = 0; i < stage->inputs.size(); i++) stage->seen[i] = stage->inputs[i]->version();
+        stage->run();
+        stage->has_run = true;
+        stage->ran();
+        ran++;
+    }
+    return ran;
+}
+
+namespace {
+    void onTrackbar(int position, void* userdata) {
+        static_cast<Observable<int>*>(userdata)->set(position);
+    }
+}
+
+void bindTrackbar(const std::string& trackbar, const std::string& window, Observable<int>& value, int max) {
+    cv::createTrackbar(trackbar, window, nullptr, max, onTrackbar, &value);
+    cv::setTrackbarPos(trackbar, window, value.get());
+}
@@ -0,0 +1,72 @@
+#ifndef RenderGraph_h
+#define RenderGraph_h
+#include <opencv2/opencv.hpp>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Anything a stage can depend on: its version grows at every change
+class Source {
+    public:
+    virtual ~Source() = default;
+    unsigned long version() const { return current_version; }
+
+    protected:
+    void touch() { current_version++; }
+
+    private:
+    unsigned long current_version = 0;
+};
+
+// A parameter of the tool; setting the same value again is not a change
+template<typename T>
+class Observable : public Source {
+    public:
+    explicit Observable(const T& value) : value(value) {}
+
+    const T& get() const { return value; }
+    void set(const T& new_value) {
+        if (new_value == value) return;
+        value = new_value;
+        touch();
+    }
+
+    private:
+    T value;
+};
+
+/*
+Small dataflow graph for the interactive tools.
+Every stage says which sources (parameters or previous stages) it reads; update() runs, in the order
+they were added, only the stages with a source that changed since their last run, and a stage that
+ran counts as changed for the stages after it.
+The trackbar callbacks only set the parameters, so all the events that arrive during one waitKey
+are coalesced in one update(), and when nothing moves update() does nothing at all.
+*/
+class RenderGraph {
+    public:
+    // The stage runs at the first update(), then whenever one of its inputs changes
+    const Source& addStage(const std::string& name, const std::vector<const Source*>& inputs, const std::function<void()>& run);
+
+    // Returns the number of stages that ran
+    int update();
+
+    private:
+    struct Stage : public Source {
+        std::string name;
+        std::vector<const Source*> inputs;
+        std::vector<unsigned long> seen; // version of every input at the last run
+        std::function<void()> run;
+        bool has_run = false;
+
+        void ran() { touch(); }
+    };
+
+    std::vector<std::unique_ptr<Stage>> stages;
+};
+
+// Trackbar that writes its position in the parameter (value also gives the initial position)
+void bindTrackbar(const std::string& trackbar, const std::string& window, Observable<int>& value, int max);
+
+#endif
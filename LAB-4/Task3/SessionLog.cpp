@@ -0,0 +1,81 @@
+#include "SessionLog.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+double elapsedMs(int64 from, int64 to) {
+    return (to - from) * 1000.0 / cv::getTickFrequency();
+}
+
+}
+
+bool SessionRecorder::open(const std::string& path) {
+    file.open(path);
+    start_tick = cv::getTickCount();
+    return file.is_open();
+}
+
+void SessionRecorder::record(const std::string& type, const std::vector<int>& values) {
+    if (!file.is_open()) return;
+    file << std::fixed << std::setprecision(3) << elapsedMs(start_tick, cv::getTickCount()) << " " << type;
+    for (int value : values) file << " " << value;
+    file << std::endl;
+}
+
+bool SessionReplayer::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) return false;
+
+    session.clear();
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') continue;
+        std::istringstream fields(line);
+        SessionEvent event;
+        if (!(fields >> event.time_ms >> event.type)) return false;
+        int value;
+        while (fields >> value) event.values.push_back(value);
+        session.push_back(event);
+    }
+    return true;
+}
+
+void SessionReplayer::run(const Dispatch& dispatch, const WaitResult& wait_result) {
+    callback_ms.clear();
+    result_ms.clear();
+    for (const SessionEvent& event : session) {
+        int64 start = cv::getTickCount();
+        dispatch(event);
+        int64 returned = cv::getTickCount();
+        wait_result();
+        int64 ready = cv::getTickCount();
+        callback_ms[event.type].push_back(elapsedMs(start, returned));
+        result_ms[event.type].push_back(elapsedMs(start, ready));
+    }
+}
+
+double SessionReplayer::percentile(std::vector<double> values, double p) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    size_t rank = (size_t)std::ceil(p / 100.0 * values.size());
+    return values[std::min(values.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+void SessionReplayer::printReport(std::ostream& out) const {
+    auto line = [&out](const std::string& name, const std::vector<double>& ms) {
+        out << "  " << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(2)
+            << " p50 " << std::setw(9) << percentile(ms, 50)
+            << "  p90 " << std::setw(9) << percentile(ms, 90)
+            << "  p99 " << std::setw(9) << percentile(ms, 99)
+            << "  max " << std::setw(9) << percentile(ms, 100) << " ms" << std::endl;
+    };
+    for (const auto& entry : callback_ms) {
+        out << entry.first << " events: " << entry.second.size() << std::endl;
+        line("callback", entry.second);
+        line("result", result_ms.at(entry.first));
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef SessionLog_h
+#define SessionLog_h
+#include <opencv2/opencv.hpp>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// One GUI event: "mouse" (event, x, y, flags) or "trackbar" (the values of all the sliders)
+struct SessionEvent {
+    double time_ms = 0; // since the start of the recording
+    std::string type;
+    std::vector<int> values;
+};
+
+/*
+Writes the GUI events of an interactive session to a text file, one event per line:
+"<milliseconds> <type> <values...>". Every line is flushed, so the log survives a crash of the tool.
+*/
+class SessionRecorder {
+    public:
+    bool open(const std::string& path);
+    bool isOpen() const { return file.is_open(); }
+    void record(const std::string& type, const std::vector<int>& values);
+
+    private:
+    std::ofstream file;
+    int64 start_tick = 0;
+};
+
+/*
+Headless replay of a recorded session, for latency benchmarks without a human in the loop.
+The events are fed back to back to dispatch (which calls the same code as the GUI callback),
+then wait_result blocks until the result of the event is ready (e.g. the background job is done).
+Every event is measured twice: the time spent in the callback (how long the GUI is blocked) and
+the time until its result is ready. Waiting for every result keeps the runs comparable: the
+cancellation of older jobs would otherwise depend on the speed of the machine.
+*/
+class SessionReplayer {
+    public:
+    // Returns false if the file cannot be read or has a wrong line
+    bool load(const std::string& path);
+    const std::vector<SessionEvent>& events() const { return session; }
+
+    typedef std::function<void(const SessionEvent& event)> Dispatch;
+    typedef std::function<void()> WaitResult;
+    void run(const Dispatch& dispatch, const WaitResult& wait_result);
+
+    // Percentiles (p50, p90, p99, max) of both latencies, per event type
+    void printReport(std::ostream& out) const;
+
+    // Nearest-rank percentile (0..100) of the values, 0 if there are none
+    static double percentile(std::vector<double> values, double p);
+
+    private:
+    std::vector<SessionEvent> session;
+    std::map<std::string, std::vector<double>> callback_ms, result_ms;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#include "SignCascade.h"
+#include "BitMask.h"
+#include "ConnectedComponents.h"
+
+namespace {
+    // Saturated and not too dark: S in [145, 255], V in [65, 255]
+    const cv::Vec3b RED(0, 200, 160), BLUE(112, 200, 160);
+    const HSVTolerance RED_TOLERANCE{10, 55, 95};  // hue 170..179 and 0..10
+    const HSVTolerance BLUE_TOLERANCE{12, 55, 95}; // hue 100..124
+
+    const int DILATION_SIZE = 7; // closes the white inside of the signs and the gaps of the rim
+    const int MIN_BLOB_AREA = 30;
+    const int MARGIN = 4;        // some background around the sign, for the gradient
+}
+
+SignCascade::SignCascade() {
+    model.addClick(RED, RED_TOLERANCE);
+    model.addClick(BLUE, BLUE_TOLERANCE);
+}
+
+void SignCascade::candidateRegions(const cv::Mat& bgr, std::vector<cv::Rect>& regions, cv::Mat* mask) const {
+    regions.clear();
+    cv::Mat hsv;
+    cv::cvtColor(bgr, hsv, cv::COLOR_BGR2HSV);
+
+    BitMask coloured;
+    model.classify(hsv, coloured);
+    cv::Mat candidates;
+    coloured.toMat(candidates);
+    cv::dilate(candidates, candidates, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(DILATION_SIZE, DILATION_SIZE)));
+    if (mask) *mask = candidates;
+
+    cv::Mat labels;
+    std::vector<ComponentStats> blobs;
+    ConnectedComponents::label(candidates, labels, blobs);
+
+    const cv::Rect image(0, 0, bgr.cols, bgr.rows);
+    for (const ComponentStats& blob : blobs) {
+        if (blob.area < MIN_BLOB_AREA) continue;
+        cv::Rect region = blob.bounding_box;
+        region = cv::Rect(region.x - MARGIN, region.y - MARGIN, region.width + 2 * MARGIN, region.height + 2 * MARGIN) & image;
+        regions.push_back(region);
+    }
+
+    // Merge the regions that overlap, otherwise the same circle would be found twice
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (size_t i = 0; i < regions.size() && !merged; i++) {
+            for (size_t j = i + 1; j < regions.size(); j++) {
+                if ((regions[i] & regions[j]).area() > 0) {
+                    regions[i] |= regions[j];
+                    regions.erase(regions.begin() + j);
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void SignCascade::detectInRegions(const std::vector<cv::Rect>& regions, const Detector& detector, std::vector<cv::Vec3f>& circles) {
+    circles.clear();
+    std::vector<cv::Vec3f> found;
+    for (const cv::Rect& region : regions) {
+        found.clear();
+        detector(region, found);
+        for (const cv::Vec3f& c : found) {
+            circles.push_back(cv::Vec3f(c[0] + region.x, c[1] + region.y, c[2]));
+        }
+    }
+}
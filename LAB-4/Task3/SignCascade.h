@@ -0,0 +1,33 @@
+#ifndef SignCascade_h
+#define SignCascade_h
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <functional>
+#include "ColorModel.h"
+
+/*
+First stage of the road sign detection: road signs are strongly red or blue, so the circles are
+only searched where those colours are.
+The red and blue HSV boxes are compiled in the ColorModel lookup table of LAB-3/Task4; the mask is
+dilated to close the rings and the gaps, and every blob that is big enough becomes a region of
+interest (overlapping regions are merged). The circle detector then runs on each region only, so
+its cost follows the coloured area instead of the frame area.
+*/
+class SignCascade {
+    public:
+    // Runs the circle detection on one region; circles are in the coordinates of the region
+    using Detector = std::function<void(const cv::Rect& region, std::vector<cv::Vec3f>& circles)>;
+
+    SignCascade();
+
+    // Regions around the red and blue blobs of the BGR image; the colour mask (after the dilation) is optional
+    void candidateRegions(const cv::Mat& bgr, std::vector<cv::Rect>& regions, cv::Mat* mask = nullptr) const;
+
+    // Runs the detector on every region and puts the circles back in image coordinates
+    static void detectInRegions(const std::vector<cv::Rect>& regions, const Detector& detector, std::vector<cv::Vec3f>& circles);
+
+    private:
+    ColorModel model;
+};
+
+#endif
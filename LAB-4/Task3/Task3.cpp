@@ -1,13 +1,53 @@
 #include <opencv2/opencv.hpp>
 #include <iostream>
+#include "CircleDetector.h"
+#include "SignCascade.h"
+#include "RenderGraph.h"
+#include "ParameterSweep.h"
+#include "PreviewLevel.h"
+#include "MaskWorker.h"
+#include "SessionLog.h"
+#include <string>
+#include <memory>
+
+// Values of the trackbars, copied by value into the background refinement
+struct CircleSettings {
+    double dp;
+    int min_dist, param1, param2, min_radius, max_radius;
+    bool pyramid_detector, prefilter;
+};
+
+// Task3 --sweep <grid file> <ground truth file> [results.csv] [image]: headless parameter search
+int runSweep(const cv::Mat& src, const std::string& grid_path, const std::string& truth_path, const std::string& csv_path);
+// Circles of one level of the image; distances, radii and votes are in the pixels of that level
+void detectCircles(const cv::Mat& gray, const cv::Mat& edges, const std::vector<cv::Rect>& regions,
+                   const CircleSettings& settings, std::vector<cv::Vec3f>& circles);
+
+int main(int argc, char** argv) {
+    // Task3 [image] [--record <session file> | --replay <session file>]
+    // or Task3 --sweep <grid file> <ground truth file> [results.csv] [image]
+    const bool sweep = argc > 3 && std::string(argv[1]) == "--sweep";
+    std::string filename = "street_scene.png", record_path, replay_path;
+    if (sweep && argc > 5) filename = argv[5];
+    for (int i = 1; !sweep && i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--record" && i + 1 < argc) record_path = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc) replay_path = argv[++i];
+        else filename = arg;
+    }
+    const bool headless = !replay_path.empty(); // replay: nothing is shown
 
-int main() {
     // Load image
-    cv::Mat src = cv::imread("street_scene.png");
+    cv::Mat src = cv::imread(filename);
     if (src.empty()) {
         std::cerr << "Error: Could not load image!" << std::endl;
         return -1;
     }
+
+    if (sweep) {
+        std::cout << "Sweep on " << filename << std::endl;
+        return runSweep(src, argv[2], argv[3], argc > 4 ? argv[4] : "sweep_results.csv");
+    }
     
     // Apply Gaussian Blur for smoothing to reduce noise
     cv::Mat blurred;
@@ -17,60 +57,213 @@ int main() {
     cv::Mat gray, edges;
     cv::cvtColor(blurred, gray, cv::COLOR_BGR2GRAY);
     cv::Canny(gray, edges, 250, 250, 3);
-    cv::imshow("Canny Edge Detection", edges);
 
     // Detect lines using HoughLines
     std::vector<cv::Vec2f> lines;
     cv::HoughLines(edges, lines, 1, CV_PI / 180, 100); 
     
-    // Create a window for interactive parameter tuning
-    cv::namedWindow("Detected Road Signs", cv::WINDOW_AUTOSIZE);
+    // Red and blue regions of the image: with the colour prefilter the circles are searched only there
+    SignCascade cascade;
+    std::vector<cv::Rect> sign_regions;
+    cv::Mat colour_mask;
+    cascade.candidateRegions(src, sign_regions, &colour_mask);
+    int candidate_area = 0;
+    for (const cv::Rect& region : sign_regions) candidate_area += region.area();
+    std::cout << sign_regions.size() << " coloured regions, " << 100.0 * candidate_area / (src.rows * src.cols)
+              << "% of the image" << std::endl;
 
-    int dp_slider = 15;          // dp = dp_slider / 10.0 (e.g., 10 -> 1.0)
-    int minDist_slider = gray.rows / 8;
-    int param1_slider = 150;     // Canny high threshold (lower threshold is half of this)
-    int param2_slider = 26;      // Accumulator threshold for circle centers
-    int minRadius_slider = 7;
-    int maxRadius_slider = 15;    // 0 means no maximum radius
+    // Big images are shown on a pyramid level: a parameter change is first computed there,
+    // and the full resolution circles are computed in the background when the user pauses
+    PreviewLevel preview(src.size());
+    cv::Mat preview_src, preview_gray, preview_edges, preview_colour_mask;
+    std::vector<cv::Rect> preview_regions;
+    preview.downscale(src, preview_src);
+    if (preview.active()) {
+        preview.downscale(gray, preview_gray);
+        cv::Canny(preview_gray, preview_edges, 250, 250, 3);
+        cascade.candidateRegions(preview_src, preview_regions, &preview_colour_mask);
+        std::cout << "Big image: previews at 1/" << (1 << preview.level()) << " resolution, refined when idle" << std::endl;
+    } else {
+        preview_gray = gray;
+        preview_edges = edges;
+        preview_regions = sign_regions;
+        preview_colour_mask = colour_mask;
+    }
+    const double to_preview = (double)preview.size().width / preview.fullSize().width;
+    if (!headless) {
+        cv::imshow("Canny Edge Detection", preview_edges);
+        cv::imshow("Colour Candidates", preview_colour_mask);
+
+        // Create a window for interactive parameter tuning
+        cv::namedWindow("Detected Road Signs", cv::WINDOW_AUTOSIZE);
+    }
+
+    // The parameters are observable: the detection only runs again when one of them changes
+    Observable<int> dp_slider(15);          // dp = dp_slider / 10.0 (e.g., 10 -> 1.0)
+    Observable<int> minDist_slider(gray.rows / 8);
+    Observable<int> param1_slider(150);     // Canny high threshold (lower threshold is half of this)
+    Observable<int> param2_slider(26);      // Accumulator threshold for circle centers
+    Observable<int> minRadius_slider(7);
+    Observable<int> maxRadius_slider(15);   // 0 means no maximum radius
+    Observable<int> detector_slider(0);     // 0: cv::HoughCircles, 1: coarse-to-fine CircleDetector
+    Observable<int> prefilter_slider(0);    // 1: only search in the red/blue regions
 
     // Create trackbars to adjust the parameters
-    cv::createTrackbar("dp x0.1", "Detected Road Signs", &dp_slider, 20);
-    cv::createTrackbar("minDist", "Detected Road Signs", &minDist_slider, gray.rows);
-    cv::createTrackbar("Canny Threshold", "Detected Road Signs", &param1_slider, 300);
-    cv::createTrackbar("Accumulator Thresh", "Detected Road Signs", &param2_slider, 100);
-    cv::createTrackbar("minRadius", "Detected Road Signs", &minRadius_slider, 100);
-    cv::createTrackbar("maxRadius", "Detected Road Signs", &maxRadius_slider, 150);
+    if (!headless) {
+        bindTrackbar("dp x0.1", "Detected Road Signs", dp_slider, 20);
+        bindTrackbar("minDist", "Detected Road Signs", minDist_slider, gray.rows);
+        bindTrackbar("Canny Threshold", "Detected Road Signs", param1_slider, 300);
+        bindTrackbar("Accumulator Thresh", "Detected Road Signs", param2_slider, 100);
+        bindTrackbar("minRadius", "Detected Road Signs", minRadius_slider, 100);
+        bindTrackbar("maxRadius", "Detected Road Signs", maxRadius_slider, 150);
+        bindTrackbar("Detector", "Detected Road Signs", detector_slider, 1);
+        bindTrackbar("Colour prefilter", "Detected Road Signs", prefilter_slider, 1);
+    }
+    // In the order of the trackbars, for the session log
+    std::vector<Observable<int>*> sliders = {&dp_slider, &minDist_slider, &param1_slider, &param2_slider,
+                                             &minRadius_slider, &maxRadius_slider, &detector_slider, &prefilter_slider};
+    auto sliderValues = [&sliders]() {
+        std::vector<int> values;
+        for (const Observable<int>* slider : sliders) values.push_back(slider->get());
+        return values;
+    };
 
-    while (true) {
-        // Clone the original image for drawing
-        cv::Mat temp = src.clone();
+    RenderGraph graph;
+    std::vector<cv::Vec3f> detected;  // in the coordinates of the window (the preview level)
+    Observable<int> refinements(0);   // grows when the full resolution circles replace the preview ones
+    MaskWorker::Job refine_job;       // full resolution job waiting for a pause
+    int64 last_change_tick = 0;
+    int changes = 0;                  // parameter changes so far, a refinement of an older one is dropped
+
+    // Declared after everything it uses, so it is stopped before them
+    MaskWorker worker;
 
+    const Source& detection = graph.addStage("circles",
+        {&dp_slider, &minDist_slider, &param1_slider, &param2_slider, &minRadius_slider, &maxRadius_slider, &detector_slider, &prefilter_slider},
+        [&]() {
         // Read trackbar positions
-        double dp = dp_slider / 10.0;
-        int minDist = minDist_slider;
-        int param1 = param1_slider;
-        int param2 = param2_slider;
-        int minRadius = minRadius_slider;
-        int maxRadius = maxRadius_slider;
+        CircleSettings settings;
+        settings.dp = dp_slider.get() / 10.0;
+        settings.min_dist = minDist_slider.get();
+        settings.param1 = param1_slider.get();
+        settings.param2 = param2_slider.get();
+        settings.min_radius = minRadius_slider.get();
+        settings.max_radius = maxRadius_slider.get();
+        settings.pyramid_detector = detector_slider.get() == 1;
+        settings.prefilter = prefilter_slider.get() == 1;
+
+        if (!preview.active()) {
+            detectCircles(gray, edges, sign_regions, settings, detected);
+            return;
+        }
+
+        // Preview now: distances and radii in the pixels of the level, and the circumferences
+        // (so the votes) are shorter by the same factor
+        CircleSettings level_settings = settings;
+        level_settings.min_dist = std::max(1, cvRound(settings.min_dist * to_preview));
+        level_settings.param2 = std::max(1, cvRound(settings.param2 * to_preview));
+        level_settings.min_radius = cvRound(settings.min_radius * to_preview);
+        if (settings.max_radius > 0) level_settings.max_radius = std::max(1, cvRound(settings.max_radius * to_preview));
+        detectCircles(preview_gray, preview_edges, preview_regions, level_settings, detected);
+        std::cout << "Preview (1/" << (1 << preview.level()) << " resolution): " << detected.size() << " circles" << std::endl;
+
+        // Full resolution later, on the worker; a newer change cancels it
+        const int change = ++changes;
+        last_change_tick = cv::getTickCount();
+        refine_job = [&, settings, change](const MaskWorker::CancelCheck& cancelled) {
+            auto circles = std::make_shared<std::vector<cv::Vec3f>>();
+            detectCircles(gray, edges, sign_regions, settings, *circles);
+            if (cancelled()) return MaskWorker::Display();
+            for (cv::Vec3f& circle : *circles) circle *= (float)to_preview;
 
-        // Detect circles using HoughCircles with current parameters
-        std::vector<cv::Vec3f> circles;
-        cv::HoughCircles(edges, circles, cv::HOUGH_GRADIENT, dp, minDist, param1, param2, minRadius, maxRadius);
+            // This part runs on the GUI thread
+            return MaskWorker::Display([&, change, circles]() {
+                // The preview runs on the GUI thread and does not cancel the job: the sliders may have moved since
+                if (change != changes) return;
+                std::cout << "Full resolution: " << circles->size() << " circles" << std::endl;
+                detected = *circles;
+                refinements.set(refinements.get() + 1);
+            });
+        };
+    });
+
+    graph.addStage("draw", {&detection, &refinements}, [&]() {
+        // Clone the original image for drawing
+        cv::Mat temp = preview_src.clone();
 
         // Draw the detected circles on the image
-        for (size_t i = 0; i < circles.size(); i++) {
-            cv::Point center(cvRound(circles[i][0]), cvRound(circles[i][1]));
-            int radius = cvRound(circles[i][2]);
+        for (size_t i = 0; i < detected.size(); i++) {
+            cv::Point center(cvRound(detected[i][0]), cvRound(detected[i][1]));
+            int radius = cvRound(detected[i][2]);
             cv::circle(temp, center, 3, cv::Scalar(0, 255, 0), -1);
             cv::circle(temp, center, radius, cv::Scalar(0, 0, 255), 3);
         }
 
         // Display the updated image
-        cv::imshow("Detected Road Signs", temp);
+        if (!headless) cv::imshow("Detected Road Signs", temp);
+    });
+
+    // Task3 --replay <file>: the recorded slider values are set back to back and every change waits
+    // for its full resolution circles, then the latency percentiles are printed
+    if (headless) {
+        SessionReplayer replayer;
+        if (!replayer.load(replay_path)) {
+            std::cerr << "Error: could not read the session " << replay_path << std::endl;
+            return -1;
+        }
+        std::cout << "Replaying " << replayer.events().size() << " events of " << replay_path << std::endl;
+        graph.update(); // the initial detection is not an event of the session
+
+        replayer.run([&](const SessionEvent& event) {
+            if (event.type != "trackbar" || event.values.size() != sliders.size()) return;
+            for (size_t i = 0; i < sliders.size(); i++) sliders[i]->set(event.values[i]);
+            graph.update(); // what the loop below does after the trackbar callbacks
+        }, [&]() {
+            // No pause to wait for: the full resolution refinement of a big image starts right away
+            if (refine_job) {
+                worker.submit(std::move(refine_job));
+                refine_job = nullptr;
+            }
+            worker.wait();
+            worker.poll();
+            graph.update();
+        });
+        replayer.printReport(std::cout);
+        return 0;
+    }
+
+    SessionRecorder recorder;
+    if (!record_path.empty()) {
+        if (!recorder.open(record_path)) {
+            std::cerr << "Error: could not write " << record_path << std::endl;
+            return -1;
+        }
+        std::cout << "Recording the session to " << record_path << std::endl;
+    }
+    std::vector<int> recorded = sliderValues(); // values of the last logged event
+
+    const double refine_delay_ms = 300; // pause after the last change before refining
+    while (true) {
+        // Logged once per update, since that is how the slider changes are handled
+        std::vector<int> values = sliderValues();
+        if (recorder.isOpen() && values != recorded) {
+            recorder.record("trackbar", values);
+            recorded = values;
+        }
+
+        // Only the stages whose parameters moved; a burst of trackbar events is a single update
+        graph.update();
 
         // Exit loop if 'q' or ESC is pressed
         char key = (char)cv::waitKey(30);
         if (key == 27 || key == 'q') break;
+        worker.poll();
+
+        double idle_ms = (cv::getTickCount() - last_change_tick) * 1000.0 / cv::getTickFrequency();
+        if (refine_job && idle_ms >= refine_delay_ms) {
+            worker.submit(std::move(refine_job));
+            refine_job = nullptr;
+        }
     }
     
     // Apply Hough Circle Transform to detect circles (road signs)
@@ -87,8 +280,69 @@ int main() {
         cv::circle(src, center, radius, cv::Scalar(0, 0, 255), 3);
     }
 
-    // Display the result
-    cv::imshow("Detected Road Signs", src);
+    // Display the result (at the preview level, like the window was)
+    cv::Mat shown;
+    preview.downscale(src, shown);
+    cv::imshow("Detected Road Signs", shown);
     cv::waitKey(0);
     return 0;
-}
\ No newline at end of file
+}
+
+void detectCircles(const cv::Mat& gray, const cv::Mat& edges, const std::vector<cv::Rect>& regions,
+                   const CircleSettings& settings, std::vector<cv::Vec3f>& circles) {
+    // Detect circles using HoughCircles with current parameters, or with the pyramid detector
+    // (it works on the gray image, since it needs the gradient, and does not use dp)
+    auto detectIn = [&](const cv::Rect& region, std::vector<cv::Vec3f>& found) {
+        if (!settings.pyramid_detector) {
+            cv::HoughCircles(edges(region), found, cv::HOUGH_GRADIENT, settings.dp, settings.min_dist, settings.param1, settings.param2,
+                             settings.min_radius, settings.max_radius);
+        } else {
+            CircleParams params;
+            params.min_dist = std::max(1, settings.min_dist);
+            params.canny_threshold = settings.param1;
+            params.votes_threshold = settings.param2;
+            params.min_radius = settings.min_radius;
+            params.max_radius = settings.max_radius;
+            CircleDetector::detect(gray(region), found, params);
+        }
+    };
+
+    if (settings.prefilter) {
+        SignCascade::detectInRegions(regions, detectIn, circles);
+    } else {
+        detectIn(cv::Rect(0, 0, gray.cols, gray.rows), circles);
+    }
+}
+
+int runSweep(const cv::Mat& src, const std::string& grid_path, const std::string& truth_path, const std::string& csv_path) {
+    std::map<std::string, std::vector<double>> grid;
+    std::vector<cv::Vec3f> ground_truth;
+    if (!ParameterSweep::loadGrid(grid_path, grid)) {
+        std::cerr << "Error: Could not read the parameter grid " << grid_path << std::endl;
+        return -1;
+    }
+    if (!ParameterSweep::loadGroundTruth(truth_path, ground_truth)) {
+        std::cerr << "Error: Could not read the ground truth " << truth_path << std::endl;
+        return -1;
+    }
+
+    cv::TickMeter timer;
+    timer.start();
+    std::vector<SweepResult> results = ParameterSweep::run(src, ParameterSweep::settings(grid, src.size()), ground_truth);
+    timer.stop();
+    if (!ParameterSweep::writeCsv(csv_path, results)) {
+        std::cerr << "Error: Could not write " << csv_path << std::endl;
+        return -1;
+    }
+
+    std::cout << results.size() << " settings evaluated in " << timer.getTimeMilli() << " ms, ranking in " << csv_path << std::endl;
+    if (!results.empty()) {
+        const SweepResult& best = results[0];
+        const SweepSetting& s = best.setting;
+        std::cout << "Best: blur " << s.blur << ", canny " << s.canny << ", dp " << s.dp << ", minDist " << s.min_dist
+                  << ", param1 " << s.param1 << ", param2 " << s.param2 << ", radius " << s.min_radius << "-" << s.max_radius
+                  << " -> F1 " << best.f1 << " (" << best.true_positives << "/" << ground_truth.size() << " signs, "
+                  << best.detected << " circles)" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,38 @@
+#ifndef FEATURE_CACHE_H
+#define FEATURE_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <opencv2/features2d.hpp> // For cv::ORB, cv::KeyPoint
+
+/*
+On-disk cache of the ORB features of the projected images, so a rerun with other matching or
+RANSAC parameters does not describe the images again.
+Every entry is a small binary file of the cache directory, named after its key: a header, the
+keypoints (7 x 4 bytes each) and the raw descriptor rows. The key mixes a hash of the pixels of
+the source image, the projection angle and all the parameters of the ORB detector, so a change of
+any of them is a miss. Hits are read through mmap; entries are written to a temporary file and
+renamed, so the workers of the Stitcher can use the cache at the same time.
+*/
+class FeatureCache {
+public:
+    // The directory is created if needed
+    explicit FeatureCache(const std::string& directory);
+
+    static uint64_t key(const cv::Mat& image, double angle, const cv::ORB& detector);
+
+    // false on a miss (or an entry that cannot be read)
+    bool load(uint64_t key, std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors) const;
+    bool store(uint64_t key, const std::vector<cv::KeyPoint>& keypoints, const cv::Mat& descriptors) const;
+
+    const std::string& directory() const { return directory_; }
+
+private:
+    std::string entryPath(uint64_t key) const;
+
+    std::string directory_;
+};
+
+#endif // FEATURE_CACHE_H
@@ -4,8 +4,12 @@
 #include <opencv2/core.hpp>
 
 cv::Mat cylindricalProj(const cv::Mat& image, const double angle);
+// Same projection, reading the source once: the colour result (for the compositing) and its gray version (for the features)
+void cylindricalProj(const cv::Mat& image, const double angle, cv::Mat& color, cv::Mat& gray);
 cv::Mat imageLoader(const std::string& imagePath);
 std::vector<cv::Mat> imagesLoader(const std::string& directoryPath);
+// Paths of the regular files of the directory, in the order of imagesLoader (nothing is decoded)
+std::vector<std::string> imagePaths(const std::string& directoryPath);
 	
 
 #endif // LAB5__PANORAMIC__UTILS__H
\ No newline at end of file
@@ -3,22 +3,38 @@
 
 #include <vector>
 #include <string>
+#include <memory>
+#include <atomic>
 #include <opencv2/core.hpp>
 #include <opencv2/features2d.hpp> // For cv::Ptr<cv::Feature2D>, cv::Ptr<cv::DescriptorMatcher>
+#include "thread_pool.h"
+#include "feature_cache.h"
 
 class Stitcher {
 public:
     // 'min_distance_ratio' is the 'ratio' multiplier for min_distance filter as per prompt.
     // 'ransac_reproj_thresh' is for cv::findHomography's RANSAC.
-    Stitcher(double min_distance_ratio = 3.0, double ransac_reproj_thresh = 5.0);
+    // 'num_threads' is the size of the thread pool (0 = one per hardware thread).
+    Stitcher(double min_distance_ratio = 3.0, double ransac_reproj_thresh = 5.0, size_t num_threads = 0);
 
     // Stitches a vector of base images.
     // 'dataset_identifier' is used to determine FoV (e.g., "dolomites" or other values like "kitchen", "lab").
     cv::Mat stitch(const std::vector<cv::Mat>& base_images, const std::string& dataset_identifier);
 
+    // Same result, streaming the images from their files through a pipeline: image i+1 is decoded while
+    // image i is projected and described and the pair (i-1, i) is matched, the last two on the thread pool.
+    // Files that cannot be read are skipped.
+    cv::Mat stitchFiles(const std::vector<std::string>& image_paths, const std::string& dataset_identifier);
+
+    // Keeps the ORB features of the projected images in 'directory', so the next runs skip the detection
+    void setFeatureCache(const std::string& directory);
+
 private:
-    cv::Ptr<cv::Feature2D> feature_detector_;
-    cv::Ptr<cv::DescriptorMatcher> matcher_;
+    std::unique_ptr<ThreadPool> pool_;
+    std::vector<cv::Ptr<cv::ORB>> feature_detectors_; // one per worker of pool_, they are not shared between threads
+    std::unique_ptr<FeatureCache> feature_cache_;     // null when there is no cache
+    std::atomic<int> cache_hits_{0}, cache_misses_{0};
+    std::vector<cv::Ptr<cv::DescriptorMatcher>> matchers_; // one per worker of pool_ (clones of the same matcher)
     double min_distance_ratio_;
     double ransac_reproj_thresh_;
 
@@ -26,8 +42,29 @@ private:
     struct ImageFeatures {
         std::vector<cv::KeyPoint> keypoints;
         cv::Mat descriptors;
-        cv::Mat image_projected; // Cylindrically projected image (grayscale as per panoramic_utils)
+        cv::Mat image_projected; // Cylindrically projected image (grayscale, for the features)
+        cv::Mat image_projected_color; // Same projection in colour, for the panorama
+    };
+
+    // Result of the matching of two consecutive images
+    struct PairResult {
+        cv::Mat H; // H_i_to_i+1 (identity when it could not be estimated)
+        std::vector<cv::DMatch> good_matches;
+        // Diagnostics collected by the worker, printed in pair order once all the pairs are done
+        std::vector<std::pair<bool, std::string>> messages; // (is error, line)
     };
+
+    // Projection and ORB features of one image (from the cache when it has them)
+    void describe(const cv::Mat& image, double angle, cv::ORB& detector, ImageFeatures& features);
+    // Prints and resets the hit counts of the cache
+    void reportCache();
+
+    // Match, filter and findHomography for images i and i+1; the matcher must not be used by another thread
+    PairResult matchPair(const ImageFeatures& features1, const ImageFeatures& features2, size_t i,
+                         cv::DescriptorMatcher& matcher) const;
+
+    // Steps 3-5 (after printing the diagnostics of step 2 and showing the matches): the panorama
+    cv::Mat compose(const std::vector<ImageFeatures>& all_image_features, const std::vector<PairResult>& pair_results);
 };
 
 #endif // STITCHER_H
\ No newline at end of file
@@ -0,0 +1,57 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/*
+Fixed set of worker threads running the submitted tasks in FIFO order.
+Every worker knows its index (workerIndex()), so a task can use per-worker state, e.g. its own
+feature detector, without locking. The results come back through std::future, so the caller
+collects them in whatever order it wants (usually the input order).
+*/
+class ThreadPool {
+public:
+    // 0 threads means one per hardware thread
+    explicit ThreadPool(size_t num_threads = 0);
+    ~ThreadPool(); // finishes the queued tasks, then joins the workers
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers_.size(); }
+
+    // Index (0..size()-1) of the worker running the calling task, -1 outside the workers of a pool
+    static int workerIndex();
+
+    template <class F>
+    std::future<typename std::result_of<F()>::type> submit(F&& task) {
+        typedef typename std::result_of<F()>::type Result;
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push([packaged]() { (*packaged)(); });
+        }
+        wake_up_.notify_one();
+        return result;
+    }
+
+private:
+    void run(int index);
+
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable wake_up_;
+    bool stop_ = false;
+};
+
+#endif // THREAD_POOL_H
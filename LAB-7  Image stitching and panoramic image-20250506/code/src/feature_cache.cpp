@@ -0,0 +1,195 @@
+#include "../include/feature_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+
+#include <fcntl.h>    // For open
+#include <sys/mman.h> // For mmap
+#include <sys/stat.h> // For fstat
+#include <unistd.h>   // For close
+
+namespace {
+
+const char MAGIC[4] = {'O', 'R', 'B', 'F'};
+const uint32_t VERSION = 1;
+
+struct EntryHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key; // checked against the file name
+    uint32_t keypoint_count;
+    int32_t descriptor_rows, descriptor_cols, descriptor_type;
+};
+
+// cv::KeyPoint without padding, so the layout of the file does not depend on the compiler
+struct KeyPointRecord {
+    float x, y, size, angle, response;
+    int32_t octave, class_id;
+};
+
+// 64-bit FNV-1a, 8 bytes at a time for the pixels
+const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+uint64_t mix(uint64_t hash, uint64_t value) {
+    return (hash ^ value) * FNV_PRIME;
+}
+
+uint64_t mix(uint64_t hash, double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return mix(hash, bits);
+}
+
+uint64_t hashPixels(const cv::Mat& image) {
+    uint64_t hash = FNV_OFFSET;
+    hash = mix(hash, (uint64_t)image.rows);
+    hash = mix(hash, (uint64_t)image.cols);
+    hash = mix(hash, (uint64_t)image.type());
+    const size_t row_bytes = image.cols * image.elemSize();
+    for (int y = 0; y < image.rows; ++y) {
+        const uchar* row = image.ptr<uchar>(y);
+        size_t x = 0;
+        for (; x + 8 <= row_bytes; x += 8) {
+            uint64_t word;
+            std::memcpy(&word, row + x, 8);
+            hash = mix(hash, word);
+        }
+        for (; x < row_bytes; ++x) hash = mix(hash, (uint64_t)row[x]);
+    }
+    return hash;
+}
+
+// Read-only mapping of a whole file, unmapped by the destructor
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* data = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                data_ = static_cast<const uchar*>(data);
+                size_ = info.st_size;
+            }
+        }
+        ::close(fd); // the mapping stays valid
+    }
+    ~MappedFile() {
+        if (data_) ::munmap(const_cast<uchar*>(data_), size_);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uchar* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uchar* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+}
+
+FeatureCache::FeatureCache(const std::string& directory) : directory_(directory) {
+    std::error_code error;
+    std::filesystem::create_directories(directory_, error);
+}
+
+uint64_t FeatureCache::key(const cv::Mat& image, double angle, const cv::ORB& detector) {
+    uint64_t hash = hashPixels(image);
+    hash = mix(hash, angle);
+    hash = mix(hash, (uint64_t)detector.getMaxFeatures());
+    hash = mix(hash, detector.getScaleFactor());
+    hash = mix(hash, (uint64_t)detector.getNLevels());
+    hash = mix(hash, (uint64_t)detector.getEdgeThreshold());
+    hash = mix(hash, (uint64_t)detector.getFirstLevel());
+    hash = mix(hash, (uint64_t)detector.getWTA_K());
+    hash = mix(hash, (uint64_t)detector.getScoreType());
+    hash = mix(hash, (uint64_t)detector.getPatchSize());
+    hash = mix(hash, (uint64_t)detector.getFastThreshold());
+    return hash;
+}
+
+std::string FeatureCache::entryPath(uint64_t key) const {
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << key << ".orb";
+    return (std::filesystem::path(directory_) / name.str()).string();
+}
+
+bool FeatureCache::load(uint64_t key, std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors) const {
+    MappedFile file(entryPath(key));
+    if (!file.data() || file.size() < sizeof(EntryHeader)) return false;
+
+    EntryHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.key != key) return false;
+    if (header.descriptor_rows < 0 || header.descriptor_cols < 0) return false;
+
+    size_t descriptor_row_bytes = header.descriptor_cols * CV_ELEM_SIZE(header.descriptor_type);
+    size_t expected = sizeof(EntryHeader) + (size_t)header.keypoint_count * sizeof(KeyPointRecord)
+                    + (size_t)header.descriptor_rows * descriptor_row_bytes;
+    if (file.size() != expected) return false; // truncated or corrupted entry
+
+    const uchar* data = file.data() + sizeof(EntryHeader);
+    keypoints.resize(header.keypoint_count);
+    for (cv::KeyPoint& keypoint : keypoints) {
+        KeyPointRecord record;
+        std::memcpy(&record, data, sizeof(record));
+        data += sizeof(record);
+        keypoint = cv::KeyPoint(record.x, record.y, record.size, record.angle, record.response, record.octave, record.class_id);
+    }
+
+    // Copied out of the mapping, which is released when leaving
+    descriptors.create(header.descriptor_rows, header.descriptor_cols, header.descriptor_type);
+    for (int y = 0; y < header.descriptor_rows; ++y) {
+        std::memcpy(descriptors.ptr<uchar>(y), data, descriptor_row_bytes);
+        data += descriptor_row_bytes;
+    }
+    return true;
+}
+
+bool FeatureCache::store(uint64_t key, const std::vector<cv::KeyPoint>& keypoints, const cv::Mat& descriptors) const {
+    EntryHeader header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.key = key;
+    header.keypoint_count = (uint32_t)keypoints.size();
+    header.descriptor_rows = descriptors.rows;
+    header.descriptor_cols = descriptors.cols;
+    header.descriptor_type = descriptors.type();
+
+    // Written next to the entry and renamed, so a reader never sees half an entry
+    std::string path = entryPath(key);
+    std::ostringstream temporary;
+    temporary << path << ".tmp" << std::this_thread::get_id();
+    {
+        std::ofstream file(temporary.str(), std::ios::binary);
+        if (!file) return false;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const cv::KeyPoint& keypoint : keypoints) {
+            KeyPointRecord record = {keypoint.pt.x, keypoint.pt.y, keypoint.size, keypoint.angle, keypoint.response,
+                                     keypoint.octave, keypoint.class_id};
+            file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+        }
+        size_t descriptor_row_bytes = descriptors.cols * descriptors.elemSize();
+        for (int y = 0; y < descriptors.rows; ++y) {
+            file.write(reinterpret_cast<const char*>(descriptors.ptr<uchar>(y)), descriptor_row_bytes);
+        }
+        if (!file) {
+            file.close();
+            std::remove(temporary.str().c_str());
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary.str(), path, error);
+    if (error) std::remove(temporary.str().c_str());
+    return !error;
+}
@@ -6,7 +6,20 @@
 #include <vector>
 #include <string>
 
-int main(){
+int main(int argc, char** argv){
+    // main [--cache <directory>]: the ORB features of the projected images are kept in the directory,
+    // so reruns with other matching parameters skip the detection (no cache by default)
+    std::string cache_directory;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--cache" && i + 1 < argc) {
+            cache_directory = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--cache <directory>]" << std::endl;
+            return 1;
+        }
+    }
+
     // Base path to the datasets folder
     std::string base_image_path = "../Images/"; // Adjust if your "Images" folder is elsewhere
 
@@ -21,6 +34,7 @@ int main(){
 
     // Create Stitcher instance
     Stitcher stitcher(3.0, 5.0); // Values can be tuned
+    if (!cache_directory.empty()) stitcher.setFeatureCache(cache_directory); // prints where it writes
 
     for (const auto& config : dataset_configs) {
         std::string dataset_dir_component = config.first;  // e.g., "dataset_dolomites/dolomites"
@@ -30,19 +44,22 @@ int main(){
 
         std::cout << "\nProcessing dataset ID: " << dataset_id << " from path: " << full_dataset_path << std::endl;
 
-        std::vector<cv::Mat> images = imagesLoader(full_dataset_path);
+        // Only the paths: the images are decoded by the stitching pipeline, while the previous ones are processed
+        std::vector<std::string> image_paths = imagePaths(full_dataset_path);
 
         // It's good practice to print the path used for loading
         std::cout << "Attempting to load images from: " << full_dataset_path << std::endl;
 
-        if (images.empty()) {
-            std::cerr << "No images loaded for dataset ID: " << dataset_id << ". Skipping." << std::endl;
+        if (image_paths.empty()) {
+            std::cerr << "No images found for dataset ID: " << dataset_id << ". Skipping." << std::endl;
             continue;
         }
-        std::cout << "Loaded " << images.size() << " images." << std::endl;
+        std::cout << "Found " << image_paths.size() << " files." << std::endl;
 
         // Perform stitching, passing the CORRECT dataset_id for FoV selection
-        cv::Mat panorama = stitcher.stitch(images, dataset_id);
+        int64 start_tick = cv::getTickCount();
+        cv::Mat panorama = stitcher.stitchFiles(image_paths, dataset_id);
+        std::cout << "Time to panorama: " << (cv::getTickCount() - start_tick) * 1000.0 / cv::getTickFrequency() << " ms" << std::endl;
 
         if (!panorama.empty()) {
             // Use the CORRECT dataset_id for the filename
@@ -3,41 +3,101 @@
 #include <opencv2/imgproc.hpp>
 #include <iostream>
 #include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
 
-cv::Mat cylindricalProj(const cv::Mat& image, const double angle)
+namespace
 {
-  cv::Mat tmp,result;
-  cv::cvtColor(image, tmp, cv::COLOR_BGR2GRAY);
-  result = tmp.clone();
+  // Inverse map of the cylindrical projection: every pixel of the result and the source pixel it comes from.
+  // It only depends on the size of the image and the angle, so it is computed once and shared by all the images.
+  struct CylindricalMap
+  {
+    cv::Mat map1, map2; // fixed-point version of the map (cv::convertMaps), for the fast bilinear remap
+  };
 
+  std::shared_ptr<const CylindricalMap> buildCylindricalMap(const cv::Size& size, const double angle)
+  {
+    double alpha(angle / 180 * CV_PI);
+    double d((size.width / 2.0) / tan(alpha));
+    double r(d/cos(alpha));
+    double d_by_r(d / r);
+    int half_height_image(size.height / 2);
+    int half_width_image(size.width / 2);
 
-  double alpha(angle / 180 * CV_PI);
-  double d((image.cols / 2.0) / tan(alpha));
-  double r(d/cos(alpha));
-  double d_by_r(d / r);
-  int half_height_image(image.rows / 2);
-  int half_width_image(image.cols / 2);
+    // The trigonometry only depends on the column: one pass over the columns
+    std::vector<float> x1_of_column(size.width), y_scale_of_column(size.width);
+    for (int col = 0; col < size.width; ++col)
+    {
+      double x(col - half_width_image);
+      x1_of_column[col] = d * tan(x / r);
+      y_scale_of_column[col] = d_by_r / cos(x / r);
+    }
 
-  for (int x = - half_width_image + 1, x_end = half_width_image; x < x_end; ++x)
-  {
-    for(int y = - half_height_image + 1, y_end = half_height_image; y < y_end; ++y)
+    // Row by row; the pixels whose source falls outside the image (and the border rows/columns
+    // that the projection never writes) keep the pixel of the input image, as before
+    cv::Mat map_x(size, CV_32FC1), map_y(size, CV_32FC1);
+    for (int row = 0; row < size.height; ++row)
+    {
+      int y(row - half_height_image);
+      float* mx = map_x.ptr<float>(row);
+      float* my = map_y.ptr<float>(row);
+      for (int col = 0; col < size.width; ++col)
       {
+        int x(col - half_width_image);
+        float x1 = x1_of_column[col];
+        float y1 = y * y_scale_of_column[col];
+        bool inside = x > - half_width_image && x < half_width_image &&
+                      y > - half_height_image && y < half_height_image &&
+                      x1 < half_width_image && x1 > - half_width_image + 1 &&
+                      y1 < half_height_image && y1 > - half_height_image + 1;
+        mx[col] = inside ? x1 + half_width_image : col;
+        my[col] = inside ? y1 + half_height_image : row;
+      }
+    }
 
-      	double x1(d * tan(x / r));
-      	double y1(y * d_by_r / cos(x / r));
+    auto map = std::make_shared<CylindricalMap>();
+    cv::convertMaps(map_x, map_y, map->map1, map->map2, CV_16SC2);
+    return map;
+  }
 
-      	if (x1 < half_width_image &&
-      			x1 > - half_width_image + 1 &&
-      			y1 < half_height_image &&
-      			y1 > -half_height_image + 1)
-      	{
-    		  result.at<uchar>(y + half_height_image, x + half_width_image) = tmp.at<uchar>(round(y1 + half_height_image),round(x1 + half_width_image));
-    	}
-    }
+  std::shared_ptr<const CylindricalMap> cylindricalMap(const cv::Size& size, const double angle)
+  {
+    static std::mutex mutex;
+    static std::map<std::tuple<int, int, double>, std::shared_ptr<const CylindricalMap>> cache;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<const CylindricalMap>& map = cache[std::make_tuple(size.width, size.height, angle)];
+    if (!map) map = buildCylindricalMap(size, angle);
+    return map;
   }
+}
+
+cv::Mat cylindricalProj(const cv::Mat& image, const double angle)
+{
+  cv::Mat tmp,result;
+  cv::cvtColor(image, tmp, cv::COLOR_BGR2GRAY);
+
+  // Bilinear interpolation through the cached fixed-point map (the vectorised path of cv::remap)
+  std::shared_ptr<const CylindricalMap> map = cylindricalMap(tmp.size(), angle);
+  cv::remap(tmp, result, map->map1, map->map2, cv::INTER_LINEAR, cv::BORDER_REPLICATE);
 
   return result;
 }
+
+void cylindricalProj(const cv::Mat& image, const double angle, cv::Mat& color, cv::Mat& gray)
+{
+  // One remap of all the channels, then the gray conversion of the projected pixels
+  // (both are linear, so it is the gray projection up to the rounding)
+  std::shared_ptr<const CylindricalMap> map = cylindricalMap(image.size(), angle);
+  cv::remap(image, color, map->map1, map->map2, cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+
+  if (color.channels() == 1)
+    gray = color;
+  else
+    cv::cvtColor(color, gray, color.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+}
 cv::Mat imageLoader(const std::string& imagePath)
 {
   cv::Mat image = cv::imread(imagePath);
@@ -47,22 +107,33 @@ cv::Mat imageLoader(const std::string& imagePath)
 std::vector<cv::Mat> imagesLoader(const std::string& directoryPath)
 {
   std::vector<cv::Mat> images;
+
+  for (const std::string& path : imagePaths(directoryPath))
+  {
+    cv::Mat image = cv::imread(path, cv::IMREAD_UNCHANGED);
+    if (image.empty())
+    {
+      std::cerr << "Error: Could not open or find the image: " << path << std::endl;
+    }
+    else
+    {
+      images.push_back(image);
+    }
+  }
+  return images;
+}
+
+std::vector<std::string> imagePaths(const std::string& directoryPath)
+{
+  std::vector<std::string> paths;
   namespace fs = std::filesystem;
-  
+
   for (const auto& entry : fs::directory_iterator(directoryPath))
   {
     if (entry.is_regular_file())
     {
-      cv::Mat image = cv::imread(entry.path().string(), cv::IMREAD_UNCHANGED);
-      if (image.empty())
-      {
-        std::cerr << "Error: Could not open or find the image: " << entry.path().string() << std::endl;
-      }
-      else
-      {
-        images.push_back(image);
-      }
+      paths.push_back(entry.path().string());
     }
   }
-  return images;
+  return paths;
 }
\ No newline at end of file
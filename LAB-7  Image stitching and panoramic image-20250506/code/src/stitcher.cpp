@@ -1,11 +1,14 @@
 #include "../include/stitcher.h"
 #include "../include/panoramic_utils.h" // For cylindricalProj, ensure this path is correct
+#include "../include/bitmask.h"         // For the packed coverage mask of the warped images
+#include "../include/bounded_queue.h"   // For the queues between the stages of stitchFiles
 
 
 #include <opencv2/imgproc.hpp>    // For warpPerspective, cvtColor, threshold
 #include <opencv2/calib3d.hpp>    // For findHomography, perspectiveTransform
 #include <opencv2/features2d.hpp> // For ORB, BFMatcher, KeyPoint, DMatch etc.
 #include <opencv2/highgui.hpp>    // For imshow, waitKey, destroyAllWindows
+#include <opencv2/imgcodecs.hpp>  // For imread
 
 #include <iostream>
 #include <vector>
@@ -13,19 +16,29 @@
 #include <stdexcept> // For std::runtime_error
 #include <limits>    // For std::numeric_limits
 #include <iomanip>   // <<--- ADDED for std::setprecision
+#include <sstream>   // For the diagnostics of the pairs
+#include <future>
+#include <thread>
+#include <exception>
+#include <filesystem> // For the absolute path of the feature cache
 
 // Constructor - ORB ONLY
-Stitcher::Stitcher(double min_distance_ratio, double ransac_reproj_thresh)
-    : min_distance_ratio_(min_distance_ratio), ransac_reproj_thresh_(ransac_reproj_thresh) {
-    feature_detector_ = cv::ORB::create();
-    if (!feature_detector_) {
-        throw std::runtime_error("Failed to create ORB feature detector.");
-    }
-    matcher_ = cv::BFMatcher::create(cv::NORM_HAMMING, false);
-    if (!matcher_) {
+Stitcher::Stitcher(double min_distance_ratio, double ransac_reproj_thresh, size_t num_threads)
+    : pool_(new ThreadPool(num_threads)), min_distance_ratio_(min_distance_ratio), ransac_reproj_thresh_(ransac_reproj_thresh) {
+    for (size_t i = 0; i < pool_->size(); ++i) {
+        feature_detectors_.push_back(cv::ORB::create());
+        if (!feature_detectors_.back()) {
+            throw std::runtime_error("Failed to create ORB feature detector.");
+        }
+    }
+    cv::Ptr<cv::DescriptorMatcher> matcher = cv::BFMatcher::create(cv::NORM_HAMMING, false);
+    if (!matcher) {
          throw std::runtime_error("Failed to create BFMatcher.");
     }
-    std::cout << "Using ORB detector and BFMatcher (NORM_HAMMING)." << std::endl;
+    for (size_t i = 0; i < pool_->size(); ++i) {
+        matchers_.push_back(matcher->clone(true));
+    }
+    std::cout << "Using ORB detector and BFMatcher (NORM_HAMMING), " << pool_->size() << " threads." << std::endl;
 }
 
 // Stitch method - WITH DEBUG OUTPUT
@@ -34,101 +47,199 @@ cv::Mat Stitcher::stitch(const std::vector<cv::Mat>& base_images, const std::str
     if (base_images.empty()) return cv::Mat();
     double fov_angle_deg = (dataset_identifier == "dolomites") ? 27.0 : 33.0;
     std::cout << "Stitching " << base_images.size() << " images for " << dataset_identifier << " (half FoV: " << fov_angle_deg << ")" << std::endl;
-    if (base_images.size() == 1) return cylindricalProj(base_images[0], fov_angle_deg);
+    if (base_images.size() == 1) {
+        cv::Mat color, gray;
+        cylindricalProj(base_images[0], fov_angle_deg, color, gray);
+        return color;
+    }
 
     std::vector<ImageFeatures> all_image_features(base_images.size());
 
-    // 1. Project images and extract features (same as before)
+    // 1. Project images and extract features, one task per image on the thread pool
     std::cout << "Step 1: Projecting images and extracting ORB features..." << std::endl;
+    std::vector<std::future<void>> step1_tasks;
     for (size_t i = 0; i < base_images.size(); ++i) {
-         all_image_features[i].image_projected = cylindricalProj(base_images[i], fov_angle_deg);
+        step1_tasks.push_back(pool_->submit([this, &base_images, &all_image_features, i, fov_angle_deg]() {
+            // Each worker has its own detector
+            describe(base_images[i], fov_angle_deg, *feature_detectors_[ThreadPool::workerIndex()], all_image_features[i]);
+        }));
+    }
+    // Wait for all the tasks before leaving (they use all_image_features), then get() rethrows their exceptions
+    for (auto& task : step1_tasks) task.wait();
+    for (auto& task : step1_tasks) task.get();
+    for (size_t i = 0; i < all_image_features.size(); ++i) {
          if (all_image_features[i].image_projected.empty()) return cv::Mat(); // Error check
-         feature_detector_->detectAndCompute(all_image_features[i].image_projected, cv::noArray(),
-                                           all_image_features[i].keypoints, all_image_features[i].descriptors);
          std::cout << "  Image " << i + 1 << ": " << all_image_features[i].keypoints.size() << " keypoints." << std::endl;
-         // Add error checks if needed
     }
+    reportCache();
 
-    // 2. Match features and estimate relative homographies
+    // 2. Match features and estimate relative homographies, one task per pair on the thread pool
     std::cout << "Step 2: Matching features and estimating relative translations..." << std::endl;
-    std::vector<cv::Mat> relative_homographies;
-
+    std::vector<std::future<PairResult>> step2_tasks;
     for (size_t i = 0; i < all_image_features.size() - 1; ++i) {
-        const auto& features1 = all_image_features[i];
-        const auto& features2 = all_image_features[i + 1];
-
-        // Skip if no features/descriptors
-        if (features1.keypoints.empty() || features2.keypoints.empty() ||
-            features1.descriptors.empty() || features2.descriptors.empty()) {
-            std::cerr << "  Skipping pair " << i+1 << "-" << i+2 << " due to missing features/descriptors." << std::endl;
-            relative_homographies.push_back(cv::Mat::eye(3, 3, CV_64F)); // Use identity
-            continue;
-        }
+        step2_tasks.push_back(pool_->submit([this, &all_image_features, i]() {
+            return matchPair(all_image_features[i], all_image_features[i + 1], i, *matchers_[ThreadPool::workerIndex()]);
+        }));
+    }
+    for (auto& task : step2_tasks) task.wait();
+    std::vector<PairResult> pair_results;
+    for (auto& task : step2_tasks) pair_results.push_back(task.get());
 
-        // Match and filter (same as before)
-        std::vector<cv::DMatch> all_raw_matches, good_matches;
-        matcher_->match(features1.descriptors, features2.descriptors, all_raw_matches);
-        if(all_raw_matches.empty()) {
-             std::cerr << "  No raw matches for pair " << i+1 << "-" << i+2 << std::endl;
-             relative_homographies.push_back(cv::Mat::eye(3, 3, CV_64F)); // Use identity
-             continue;
-        }
-        double min_dist = std::numeric_limits<double>::max();
-        for(const auto& match : all_raw_matches) min_dist = std::min(min_dist, (double)match.distance);
-        double distance_threshold = min_distance_ratio_ * min_dist;
-        for(const auto& match : all_raw_matches) {
-            if (match.distance < distance_threshold) good_matches.push_back(match);
+    return compose(all_image_features, pair_results);
+}
+
+cv::Mat Stitcher::stitchFiles(const std::vector<std::string>& image_paths, const std::string& dataset_identifier) {
+    if (image_paths.empty()) return cv::Mat();
+    double fov_angle_deg = (dataset_identifier == "dolomites") ? 27.0 : 33.0;
+    std::cout << "Streaming " << image_paths.size() << " files for " << dataset_identifier << " (half FoV: " << fov_angle_deg << ")" << std::endl;
+
+    // Small queues between the stages: every stage has its next item ready, but the decoder
+    // cannot run far ahead and keep all the images in memory. The described queue holds the
+    // futures of the images being described, enough to keep every worker of the pool busy.
+    typedef std::shared_ptr<ImageFeatures> FeaturesPtr;
+    BoundedQueue<cv::Mat> decoded(2);
+    BoundedQueue<std::future<FeaturesPtr>> described(pool_->size() + 1);
+    std::exception_ptr decode_error, dispatch_error;
+
+    // Stage 1: decoding
+    std::thread decoder([&]() {
+        try {
+            for (const std::string& path : image_paths) {
+                cv::Mat image = cv::imread(path, cv::IMREAD_UNCHANGED);
+                if (image.empty()) {
+                    std::cerr << "Error: Could not open or find the image: " << path << std::endl;
+                    continue;
+                }
+                if (!decoded.push(image)) break; // the next stage stopped
+            }
+        } catch (...) {
+            decode_error = std::current_exception();
         }
-        std::cout << "  Pair " << i + 1 << "-" << i + 2 << ": Raw=" << all_raw_matches.size()
-                  << ", MinDist=" << min_dist << ", Thresh=" << distance_threshold
-                  << ", Good=" << good_matches.size() << std::endl;
-
-        // --- Visualization (same as before) ---
-        if (!good_matches.empty()) {
-            cv::Mat img_matches;
-            cv::drawMatches(features1.image_projected, features1.keypoints,
-                            features2.image_projected, features2.keypoints,
-                            good_matches, img_matches, cv::Scalar::all(-1), cv::Scalar::all(-1),
-                            std::vector<char>(), cv::DrawMatchesFlags::NOT_DRAW_SINGLE_POINTS);
-            std::string window_title = "Matches " + std::to_string(i + 1) + "-" + std::to_string(i + 2);
-            cv::imshow(window_title, img_matches);
-            std::cout << "  Showing matches for pair " << i + 1 << "-" << i + 2 << ". Press any key..." << std::endl;
-            cv::waitKey(0);
-            cv::destroyWindow(window_title);
+        decoded.close();
+    });
+
+    // Stage 2: projection and ORB features of every decoded image on the thread pool (each worker has
+    // its own detector); the futures are queued in input order, whatever order the images finish in
+    std::thread dispatcher([&]() {
+        try {
+            cv::Mat image;
+            while (decoded.pop(image)) {
+                std::future<FeaturesPtr> features = pool_->submit([this, image, fov_angle_deg]() {
+                    FeaturesPtr features = std::make_shared<ImageFeatures>();
+                    describe(image, fov_angle_deg, *feature_detectors_[ThreadPool::workerIndex()], *features);
+                    return features;
+                });
+                if (!described.push(std::move(features))) break;
+            }
+        } catch (...) {
+            dispatch_error = std::current_exception();
         }
-
-        // Estimate Homography
-        cv::Mat H; // H_i_to_i+1
-        if (good_matches.size() >= 4) {
-            std::vector<cv::Point2f> points1, points2;
-            for (const auto& match : good_matches) {
-                points1.push_back(features1.keypoints[match.queryIdx].pt);
-                points2.push_back(features2.keypoints[match.trainIdx].pt);
+        decoded.close(); // unblocks the decoder if this stage stopped early
+        described.close();
+    });
+
+    // Stage 3 (this thread): the pair (i-1, i) goes to the pool as soon as image i is described
+    std::vector<FeaturesPtr> all_features;
+    std::vector<std::future<PairResult>> pair_tasks;
+    auto finish = [&]() {
+        described.close();
+        decoded.close();
+        decoder.join();
+        dispatcher.join();
+        for (auto& task : pair_tasks) task.wait();
+    };
+    try {
+        std::future<FeaturesPtr> next;
+        while (described.pop(next)) {
+            FeaturesPtr features = next.get();
+            if (features->image_projected.empty()) { // Error check, as in stitch()
+                finish();
+                return cv::Mat();
             }
-             // *** Add mask output from findHomography ***
-            std::vector<unsigned char> ransac_mask;
-            H = cv::findHomography(points1, points2, cv::RANSAC, ransac_reproj_thresh_, ransac_mask);
-
-            // *** DEBUG: Count RANSAC inliers ***
-            int inlier_count = 0;
-            for(unsigned char mask_val : ransac_mask) {
-                if(mask_val) inlier_count++;
+            all_features.push_back(features);
+            size_t i = all_features.size() - 1;
+            std::cout << "  Image " << i + 1 << ": " << features->keypoints.size() << " keypoints." << std::endl;
+            if (i > 0) {
+                FeaturesPtr previous = all_features[i - 1];
+                pair_tasks.push_back(pool_->submit([this, previous, features, i]() {
+                    return matchPair(*previous, *features, i - 1, *matchers_[ThreadPool::workerIndex()]);
+                }));
             }
-            std::cout << "  findHomography RANSAC inliers: " << inlier_count << "/" << good_matches.size() << std::endl;
+        }
+    } catch (...) {
+        finish();
+        throw;
+    }
+    finish();
+    if (decode_error) std::rethrow_exception(decode_error);
+    if (dispatch_error) std::rethrow_exception(dispatch_error);
+    std::vector<PairResult> pair_results;
+    for (auto& task : pair_tasks) pair_results.push_back(task.get());
+    reportCache();
+
+    if (all_features.empty()) return cv::Mat();
+    std::vector<ImageFeatures> all_image_features;
+    for (const FeaturesPtr& features : all_features) all_image_features.push_back(std::move(*features));
+    if (all_image_features.size() == 1) return all_image_features[0].image_projected_color;
+    return compose(all_image_features, pair_results);
+}
 
-            if (H.empty() || inlier_count < 4) { // Check if H is valid and enough inliers support it
-                 std::cerr << "  findHomography failed or insufficient inliers for pair " << i + 1 << "-" << i + 2 << ". Using identity." << std::endl;
-                 H = cv::Mat::eye(3, 3, CV_64F);
-            }
-        } else {
-            std::cerr << "  Not enough good matches (" << good_matches.size() << ") for pair " << i + 1 << "-" << i + 2 << ". Using identity." << std::endl;
-            H = cv::Mat::eye(3, 3, CV_64F);
+void Stitcher::setFeatureCache(const std::string& directory) {
+    feature_cache_.reset(new FeatureCache(directory));
+    std::cout << "Feature cache: " << std::filesystem::absolute(directory).string() << std::endl;
+}
+
+void Stitcher::describe(const cv::Mat& image, double angle, cv::ORB& detector, ImageFeatures& features) {
+    cylindricalProj(image, angle, features.image_projected_color, features.image_projected);
+    if (features.image_projected.empty()) return;
+
+    // The key hashes the source image, the projection is always needed for the panorama anyway
+    uint64_t key = 0;
+    if (feature_cache_) {
+        key = FeatureCache::key(image, angle, detector);
+        if (feature_cache_->load(key, features.keypoints, features.descriptors)) {
+            cache_hits_++;
+            return;
         }
+        cache_misses_++;
+    }
+    detector.detectAndCompute(features.image_projected, cv::noArray(), features.keypoints, features.descriptors);
+    if (feature_cache_ && !feature_cache_->store(key, features.keypoints, features.descriptors)) {
+        std::cerr << "  Warning: could not write the features to the cache " << feature_cache_->directory() << std::endl;
+    }
+}
 
-        // *** DEBUG: Print Relative Homography ***
-        std::cout << "  Relative H[" << i << "] (Image " << i+1 << " -> " << i+2 << "):\n" << H << std::endl;
+void Stitcher::reportCache() {
+    if (!feature_cache_) return;
+    std::cout << "  Feature cache: " << cache_hits_ << " hits, " << cache_misses_ << " misses." << std::endl;
+    cache_hits_ = 0;
+    cache_misses_ = 0;
+}
+
+cv::Mat Stitcher::compose(const std::vector<ImageFeatures>& all_image_features, const std::vector<PairResult>& pair_results) {
+    // Diagnostics in pair order, whatever order the pairs finished in
+    std::vector<cv::Mat> relative_homographies;
+    for (const PairResult& pair : pair_results) {
+        for (const auto& message : pair.messages) {
+            (message.first ? std::cerr : std::cout) << message.second << std::endl;
+        }
+        relative_homographies.push_back(pair.H);
+    }
 
-        relative_homographies.push_back(H);
+    // --- Visualization (on this thread, once all the pairs are done) ---
+    for (size_t i = 0; i < pair_results.size(); ++i) {
+        const std::vector<cv::DMatch>& good_matches = pair_results[i].good_matches;
+        if (good_matches.empty()) continue;
+        cv::Mat img_matches;
+        cv::drawMatches(all_image_features[i].image_projected, all_image_features[i].keypoints,
+                        all_image_features[i + 1].image_projected, all_image_features[i + 1].keypoints,
+                        good_matches, img_matches, cv::Scalar::all(-1), cv::Scalar::all(-1),
+                        std::vector<char>(), cv::DrawMatchesFlags::NOT_DRAW_SINGLE_POINTS);
+        std::string window_title = "Matches " + std::to_string(i + 1) + "-" + std::to_string(i + 2);
+        cv::imshow(window_title, img_matches);
+        std::cout << "  Showing matches for pair " << i + 1 << "-" << i + 2 << ". Press any key..." << std::endl;
+        cv::waitKey(0);
+        cv::destroyWindow(window_title);
     }
 
     // 3. Accumulate homographies
@@ -207,7 +318,7 @@ cv::Mat Stitcher::stitch(const std::vector<cv::Mat>& base_images, const std::str
     cv::Mat T_offset_to_canvas = cv::Mat::eye(3, 3, CV_64F);
     T_offset_to_canvas.at<double>(0,2) = -panorama_roi.x;
     T_offset_to_canvas.at<double>(1,2) = -panorama_roi.y;
-    int pano_type = all_image_features[0].image_projected.type();
+    int pano_type = all_image_features[0].image_projected_color.type();
     cv::Mat panorama(panorama_roi.height, panorama_roi.width, pano_type);
     panorama.setTo(cv::Scalar(0));
 
@@ -227,26 +338,88 @@ cv::Mat Stitcher::stitch(const std::vector<cv::Mat>& base_images, const std::str
         // std::cout << "  Final Warp H for Image " << i << ":\n" << H_final_warp << std::endl; // Optional: Can be very verbose
 
         cv::Mat warped_image;
-        cv::warpPerspective(all_image_features[i].image_projected, warped_image, H_final_warp,
+        cv::warpPerspective(all_image_features[i].image_projected_color, warped_image, H_final_warp,
                             panorama.size(), cv::INTER_LINEAR, cv::BORDER_TRANSPARENT);
 
-        // --- Masking and Copying (same as before) ---
-        cv::Mat mask;
-        if (warped_image.channels() == 1) {
-            cv::threshold(warped_image, mask, 0, 255, cv::THRESH_BINARY);
-        } else {
-             std::vector<cv::Mat> channels;
-             cv::split(warped_image, channels);
-             if (!channels.empty()) { // Check if split was successful
-                 cv::threshold(channels[0], mask, 0, 255, cv::THRESH_BINARY);
-             } else { // Fallback if split fails
-                 mask = cv::Mat::ones(warped_image.size(), CV_8U) * 255;
-                 std::cerr << "Warning: Could not split channels for mask creation on image " << i << ". Using default mask." << std::endl;
-             }
-        }
-        warped_image.copyTo(panorama, mask);
+        // --- Masking and Copying ---
+        // Coverage of the warped image packed one bit per pixel (a pixel is covered if any channel is non zero),
+        // empty bytes skip 8 pixels at once during the copy
+        BitMask coverage(warped_image);
+        coverage.copyMasked(warped_image, panorama);
     }
 
     std::cout << "Stitching complete using ORB." << std::endl;
     return panorama;
-}
\ No newline at end of file
+}
+
+Stitcher::PairResult Stitcher::matchPair(const ImageFeatures& features1, const ImageFeatures& features2, size_t i,
+                                         cv::DescriptorMatcher& matcher) const {
+    PairResult result;
+    std::string pair_name = std::to_string(i + 1) + "-" + std::to_string(i + 2);
+    auto log = [&result](bool error, const std::string& line) { result.messages.emplace_back(error, line); };
+
+    // Skip if no features/descriptors
+    if (features1.keypoints.empty() || features2.keypoints.empty() ||
+        features1.descriptors.empty() || features2.descriptors.empty()) {
+        log(true, "  Skipping pair " + pair_name + " due to missing features/descriptors.");
+        result.H = cv::Mat::eye(3, 3, CV_64F); // Use identity
+        return result;
+    }
+
+    // Match and filter
+    std::vector<cv::DMatch> all_raw_matches;
+    std::vector<cv::DMatch>& good_matches = result.good_matches;
+    matcher.match(features1.descriptors, features2.descriptors, all_raw_matches);
+    if(all_raw_matches.empty()) {
+         log(true, "  No raw matches for pair " + pair_name);
+         result.H = cv::Mat::eye(3, 3, CV_64F); // Use identity
+         return result;
+    }
+    double min_dist = std::numeric_limits<double>::max();
+    for(const auto& match : all_raw_matches) min_dist = std::min(min_dist, (double)match.distance);
+    double distance_threshold = min_distance_ratio_ * min_dist;
+    for(const auto& match : all_raw_matches) {
+        if (match.distance < distance_threshold) good_matches.push_back(match);
+    }
+    std::ostringstream line;
+    line << "  Pair " << pair_name << ": Raw=" << all_raw_matches.size()
+         << ", MinDist=" << min_dist << ", Thresh=" << distance_threshold
+         << ", Good=" << good_matches.size();
+    log(false, line.str());
+
+    // Estimate Homography
+    cv::Mat H; // H_i_to_i+1
+    if (good_matches.size() >= 4) {
+        std::vector<cv::Point2f> points1, points2;
+        for (const auto& match : good_matches) {
+            points1.push_back(features1.keypoints[match.queryIdx].pt);
+            points2.push_back(features2.keypoints[match.trainIdx].pt);
+        }
+         // *** Add mask output from findHomography ***
+        std::vector<unsigned char> ransac_mask;
+        H = cv::findHomography(points1, points2, cv::RANSAC, ransac_reproj_thresh_, ransac_mask);
+
+        // *** DEBUG: Count RANSAC inliers ***
+        int inlier_count = 0;
+        for(unsigned char mask_val : ransac_mask) {
+            if(mask_val) inlier_count++;
+        }
+        log(false, "  findHomography RANSAC inliers: " + std::to_string(inlier_count) + "/" + std::to_string(good_matches.size()));
+
+        if (H.empty() || inlier_count < 4) { // Check if H is valid and enough inliers support it
+             log(true, "  findHomography failed or insufficient inliers for pair " + pair_name + ". Using identity.");
+             H = cv::Mat::eye(3, 3, CV_64F);
+        }
+    } else {
+        log(true, "  Not enough good matches (" + std::to_string(good_matches.size()) + ") for pair " + pair_name + ". Using identity.");
+        H = cv::Mat::eye(3, 3, CV_64F);
+    }
+
+    // *** DEBUG: Print Relative Homography ***
+    std::ostringstream h_text;
+    h_text << "  Relative H[" << i << "] (Image " << i+1 << " -> " << i+2 << "):\n" << H;
+    log(false, h_text.str());
+
+    result.H = H;
+    return result;
+}
@@ -0,0 +1,42 @@
+#include "../include/thread_pool.h"
+
+#include <algorithm>
+
+namespace {
+thread_local int current_worker = -1;
+}
+
+ThreadPool::ThreadPool(size_t num_threads) {
+    if (num_threads == 0) num_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < num_threads; ++i) {
+        workers_.emplace_back(&ThreadPool::run, this, (int)i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_up_.notify_all();
+    for (std::thread& worker : workers_) worker.join();
+}
+
+int ThreadPool::workerIndex() {
+    return current_worker;
+}
+
+void ThreadPool::run(int index) {
+    current_worker = index;
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_up_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+            if (tasks_.empty()) return; // stopping and nothing left to do
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }
+        task(); // exceptions end up in the future of the task
+    }
+}